@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: MIT
+// TLS benchmark: full handshakes/sec, resumed handshakes/sec and bulk MB/s
+// over loopback for a matrix of server configurations
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/rsa.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ssl_ciphersuites.h>
+#include <mbedtls/x509_crt.h>
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+# include <psa/crypto.h>
+#endif
+
+#include "ews.h"
+
+
+#define BENCH_HOST "127.0.0.1"
+#define BENCH_PORT "18443"
+#define BENCH_BULK_SIZE (64 * 1024 * 1024)
+
+/// IANA named groups
+#define GROUP_SECP256R1 23
+#define GROUP_X25519 29
+
+typedef struct bench_keys bench_keys_t;
+typedef struct bench_cfg bench_cfg_t;
+
+struct bench_keys {
+    char crt[4096];
+    char key[4096];
+};
+
+struct bench_cfg {
+    const char *name;
+    mbedtls_pk_type_t key;
+    int version;
+    const int *suites;
+    const uint16_t *groups;
+};
+
+static const int suites_ecdsa_gcm[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0,
+};
+static const int suites_ecdsa_chacha[] = {
+    MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256, 0,
+};
+static const int suites_rsa_gcm[] = {
+    MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256, 0,
+};
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+static const int suites_tls13_gcm[] = {
+    MBEDTLS_TLS1_3_AES_128_GCM_SHA256, 0,
+};
+#endif
+static const uint16_t groups_x25519[] = {GROUP_X25519, 0};
+static const uint16_t groups_p256[] = {GROUP_SECP256R1, 0};
+
+static const bench_cfg_t bench_cfgs[] = {
+    {"rsa2048 tls1.2 aes128gcm x25519", MBEDTLS_PK_RSA, EWS_TLS_VERSION_1_2,
+            suites_rsa_gcm, groups_x25519},
+    {"p256 tls1.2 aes128gcm x25519", MBEDTLS_PK_ECKEY, EWS_TLS_VERSION_1_2,
+            suites_ecdsa_gcm, groups_x25519},
+    {"p256 tls1.2 aes128gcm p256", MBEDTLS_PK_ECKEY, EWS_TLS_VERSION_1_2,
+            suites_ecdsa_gcm, groups_p256},
+    {"p256 tls1.2 chacha20 x25519", MBEDTLS_PK_ECKEY, EWS_TLS_VERSION_1_2,
+            suites_ecdsa_chacha, groups_x25519},
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    {"rsa2048 tls1.3 aes128gcm x25519", MBEDTLS_PK_RSA, EWS_TLS_VERSION_1_3,
+            suites_tls13_gcm, groups_x25519},
+    {"p256 tls1.3 aes128gcm x25519", MBEDTLS_PK_ECKEY, EWS_TLS_VERSION_1_3,
+            suites_tls13_gcm, groups_x25519},
+#endif
+};
+
+static mbedtls_entropy_context entropy;
+static mbedtls_ctr_drbg_context drbg;
+static size_t bulk_left;
+
+static double now_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool gen_keys(bench_keys_t *keys, mbedtls_pk_type_t type)
+{
+    mbedtls_x509write_cert crt;
+    mbedtls_pk_context pk;
+    bool ok = false;
+    int ret;
+
+    mbedtls_pk_init(&pk);
+    mbedtls_x509write_crt_init(&crt);
+
+    ret = mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(type));
+    if (ret != 0) {
+        goto done;
+    }
+    if (type == MBEDTLS_PK_RSA) {
+        ret = mbedtls_rsa_gen_key(mbedtls_pk_rsa(pk), mbedtls_ctr_drbg_random,
+                &drbg, 2048, 65537);
+    } else {
+        ret = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(pk),
+                mbedtls_ctr_drbg_random, &drbg);
+    }
+    if (ret != 0) {
+        goto done;
+    }
+
+    ret = mbedtls_pk_write_key_pem(&pk, (unsigned char *) keys->key,
+            sizeof(keys->key));
+    if (ret != 0) {
+        goto done;
+    }
+
+    /// self-signed, the client does not verify it
+    mbedtls_x509write_crt_set_version(&crt, MBEDTLS_X509_CRT_VERSION_3);
+    mbedtls_x509write_crt_set_md_alg(&crt, MBEDTLS_MD_SHA256);
+    mbedtls_x509write_crt_set_subject_key(&crt, &pk);
+    mbedtls_x509write_crt_set_issuer_key(&crt, &pk);
+    mbedtls_x509write_crt_set_subject_name(&crt, "CN=localhost");
+    mbedtls_x509write_crt_set_issuer_name(&crt, "CN=localhost");
+    mbedtls_x509write_crt_set_validity(&crt, "20240101000000",
+            "20991231235959");
+#if MBEDTLS_VERSION_NUMBER >= 0x03040000
+    ret = mbedtls_x509write_crt_set_serial_raw(&crt, (unsigned char *) "\x01",
+            1);
+#else
+    {
+        mbedtls_mpi serial;
+
+        mbedtls_mpi_init(&serial);
+        mbedtls_mpi_lset(&serial, 1);
+        ret = mbedtls_x509write_crt_set_serial(&crt, &serial);
+        mbedtls_mpi_free(&serial);
+    }
+#endif
+    if (ret != 0) {
+        goto done;
+    }
+
+    ret = mbedtls_x509write_crt_pem(&crt, (unsigned char *) keys->crt,
+            sizeof(keys->crt), mbedtls_ctr_drbg_random, &drbg);
+    ok = ret == 0;
+
+done:
+    mbedtls_x509write_crt_free(&crt);
+    mbedtls_pk_free(&pk);
+    return ok;
+}
+
+static bool bulk_produce(ews_sess_t *sess, void *arg, size_t budget)
+{
+    static char buf[16384];
+    size_t len = budget < sizeof(buf) ? budget : sizeof(buf);
+    ssize_t ret;
+
+    if (len > bulk_left) {
+        len = bulk_left;
+    }
+
+    ret = sess->ops->send(sess, buf, len);
+    if (ret < 0) {
+        return false;
+    }
+    bulk_left -= ret;
+    return bulk_left > 0;
+}
+
+static ews_route_status_t bulk_handler(ews_sess_t *sess,
+        ews_sess_state_t state)
+{
+    char s[16];
+
+    switch (state) {
+    case EWS_SESS_REQUEST_BEGIN:
+        return EWS_ROUTE_STATUS_FOUND;
+
+    case EWS_SESS_RESPONSE_BEGIN:
+        sess->ops->status(sess, 200, "OK");
+        return EWS_ROUTE_STATUS_NEXT;
+
+    case EWS_SESS_RESPONSE_HEADER:
+        snprintf(s, sizeof(s), "%d", BENCH_BULK_SIZE);
+        sess->ops->header(sess, "Content-Length", s);
+        bulk_left = BENCH_BULK_SIZE;
+        return EWS_ROUTE_STATUS_NEXT;
+
+    case EWS_SESS_RESPONSE_BODY:
+        sess->ops->produce(sess, bulk_produce, NULL);
+        return EWS_ROUTE_STATUS_MORE;
+
+    default:
+        return EWS_ROUTE_STATUS_NEXT;
+    }
+}
+
+static void run_server(const bench_cfg_t *cfg, const bench_keys_t *keys)
+{
+    ews_config_t config = {0};
+    ews_t *ews;
+
+#if CONFIG_EWS_HTTP_CLIENTS > 0
+    config.http_listen_port = atoi(BENCH_PORT) + 1;
+#endif
+    config.https_listen_port = atoi(BENCH_PORT);
+    config.https_crt = keys->crt;
+    config.https_crt_len = strlen(keys->crt) + 1;
+    config.https_pk = keys->key;
+    config.https_pk_len = strlen(keys->key) + 1;
+    config.https_ciphersuites = cfg->suites;
+    config.https_groups = cfg->groups;
+    config.https_min_version = cfg->version;
+    config.https_max_version = cfg->version;
+
+    ews = ews_init(&config);
+    if (ews == NULL) {
+        fprintf(stderr, "ews_init failed\n");
+        exit(EXIT_FAILURE);
+    }
+    ews_route_append(ews, "/bulk", bulk_handler, 0);
+
+    while (true) {
+        pause();
+    }
+}
+
+static void client_conf(mbedtls_ssl_config *conf, const bench_cfg_t *cfg)
+{
+    mbedtls_ssl_config_init(conf);
+    mbedtls_ssl_config_defaults(conf, MBEDTLS_SSL_IS_CLIENT,
+            MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, &drbg);
+    mbedtls_ssl_conf_read_timeout(conf, 200);
+#if MBEDTLS_VERSION_NUMBER >= 0x03020000
+    mbedtls_ssl_conf_min_tls_version(conf, cfg->version);
+    mbedtls_ssl_conf_max_tls_version(conf, cfg->version);
+#else
+    mbedtls_ssl_conf_min_version(conf, MBEDTLS_SSL_MAJOR_VERSION_3,
+            cfg->version & 0xff);
+    mbedtls_ssl_conf_max_version(conf, MBEDTLS_SSL_MAJOR_VERSION_3,
+            cfg->version & 0xff);
+#endif
+}
+
+static int client_connect(mbedtls_ssl_config *conf, mbedtls_net_context *net,
+        mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session)
+{
+    int ret;
+
+    mbedtls_net_init(net);
+    mbedtls_ssl_init(ssl);
+
+    ret = mbedtls_net_connect(net, BENCH_HOST, BENCH_PORT,
+            MBEDTLS_NET_PROTO_TCP);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = mbedtls_ssl_setup(ssl, conf);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_set_hostname(ssl, "localhost");
+    mbedtls_ssl_set_bio(ssl, net, mbedtls_net_send, NULL,
+            mbedtls_net_recv_timeout);
+    if (session) {
+        mbedtls_ssl_set_session(ssl, session);
+    }
+    return mbedtls_ssl_handshake(ssl);
+}
+
+static void client_close(mbedtls_net_context *net, mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_close_notify(ssl);
+    mbedtls_ssl_free(ssl);
+    mbedtls_net_free(net);
+}
+
+static double bench_handshakes(const bench_cfg_t *cfg, bool resume,
+        double secs)
+{
+    mbedtls_ssl_session session;
+    mbedtls_ssl_config conf;
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    bool have_session = false;
+    double start, end;
+    int count = 0;
+    int ret;
+
+    client_conf(&conf, cfg);
+    mbedtls_ssl_session_init(&session);
+
+    start = now_s();
+    end = start;
+    do {
+        ret = client_connect(&conf, &net, &ssl,
+                have_session ? &session : NULL);
+        if (ret != 0) {
+            fprintf(stderr, "handshake failed: -0x%04x\n", -ret);
+            client_close(&net, &ssl);
+            count = 0;
+            break;
+        }
+
+        if (resume && !have_session) {
+            unsigned char c;
+
+            /// TLS 1.3 tickets arrive after the handshake
+            mbedtls_ssl_read(&ssl, &c, 1);
+            have_session = mbedtls_ssl_get_session(&ssl, &session) == 0;
+            start = now_s();
+        } else {
+            count++;
+        }
+        client_close(&net, &ssl);
+        end = now_s();
+    } while (end - start < secs);
+
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_config_free(&conf);
+    return count / (end - start);
+}
+
+static double bench_bulk(const bench_cfg_t *cfg)
+{
+    static const char req[] = "GET /bulk HTTP/1.1\r\nHost: localhost\r\n"
+            "Connection: close\r\n\r\n";
+    static unsigned char buf[16384];
+    mbedtls_ssl_config conf;
+    mbedtls_net_context net;
+    mbedtls_ssl_context ssl;
+    size_t total = 0;
+    double start, end;
+    int ret;
+
+    client_conf(&conf, cfg);
+    mbedtls_ssl_conf_read_timeout(&conf, 5000);
+
+    ret = client_connect(&conf, &net, &ssl, NULL);
+    if (ret != 0) {
+        client_close(&net, &ssl);
+        mbedtls_ssl_config_free(&conf);
+        return 0;
+    }
+
+    start = now_s();
+    mbedtls_ssl_write(&ssl, (const unsigned char *) req, sizeof(req) - 1);
+    while (total < BENCH_BULK_SIZE) {
+        ret = mbedtls_ssl_read(&ssl, buf, sizeof(buf));
+        if (ret <= 0) {
+            break;
+        }
+        total += ret;
+    }
+    end = now_s();
+
+    client_close(&net, &ssl);
+    mbedtls_ssl_config_free(&conf);
+    return total / (end - start) / (1024 * 1024);
+}
+
+static bool wait_server(void)
+{
+    mbedtls_net_context net;
+
+    for (int i = 0; i < 50; i++) {
+        mbedtls_net_init(&net);
+        if (mbedtls_net_connect(&net, BENCH_HOST, BENCH_PORT,
+                MBEDTLS_NET_PROTO_TCP) == 0) {
+            mbedtls_net_free(&net);
+            return true;
+        }
+        mbedtls_net_free(&net);
+        usleep(100000);
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_keys_t rsa_keys, ec_keys;
+    double secs = 2.0;
+
+    if (argc > 1) {
+        secs = atof(argv[1]);
+    }
+
+    /// the pooled allocator has to see every mbedtls allocation
+    ews_tls_mem_init();
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+    psa_crypto_init();
+#endif
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    if (mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, NULL,
+            0) != 0) {
+        fprintf(stderr, "mbedtls_ctr_drbg_seed failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!gen_keys(&rsa_keys, MBEDTLS_PK_RSA) ||
+            !gen_keys(&ec_keys, MBEDTLS_PK_ECKEY)) {
+        fprintf(stderr, "key generation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%-34s %10s %10s %10s\n", "configuration", "full/s", "resumed/s",
+            "MB/s");
+
+    for (size_t i = 0; i < sizeof(bench_cfgs) / sizeof(*bench_cfgs); i++) {
+        const bench_cfg_t *cfg = &bench_cfgs[i];
+        pid_t pid;
+
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return EXIT_FAILURE;
+        } else if (pid == 0) {
+            run_server(cfg, cfg->key == MBEDTLS_PK_RSA ? &rsa_keys : &ec_keys);
+        }
+
+        if (wait_server()) {
+            double full = bench_handshakes(cfg, false, secs);
+            double resumed = bench_handshakes(cfg, true, secs);
+            double bulk = bench_bulk(cfg);
+            printf("%-34s %10.1f %10.1f %10.1f\n", cfg->name, full, resumed,
+                    bulk);
+        } else {
+            printf("%-34s %10s\n", cfg->name, "no server");
+        }
+
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+    ews_tls_mem_destroy();
+    return EXIT_SUCCESS;
+}
@@ -8,8 +8,10 @@ extern "C" {
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #include "ews_config.h"
+#include "ews_header_id.h"
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -19,10 +21,22 @@ extern "C" {
 /// web server configuration type
 typedef struct ews_config ews_config_t;
 
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 || defined(__DOXYGEN__)
+/// TLS 1.2 for @a https_min_version and @a https_max_version
+#define EWS_TLS_VERSION_1_2 0x0303
+/// TLS 1.3 for @a https_min_version and @a https_max_version
+#define EWS_TLS_VERSION_1_3 0x0304
+#endif
+
 /// web server configuration struct
 struct ews_config {
     /// millisecond idle timeout
     int idle_timeout;
+    /// millisecond idle timeout of a session whose request body is paused
+    int pause_timeout;
+    /// Server response header value, NULL for @a CONFIG_EWS_SERVER_NAME and
+    /// an empty string to send none
+    const char *server_name;
 
 #if CONFIG_EWS_HTTP_CLIENTS > 0 || defined(__DOXYGEN__)
     /// port to use for http listen socket
@@ -36,6 +50,46 @@ struct ews_config {
     int https_listen_port;
     /// backlog for https listen socket
     int https_listen_backlog;
+    /// maximum number of TLS handshakes in progress at once
+    int https_handshakes_max;
+    /// maximum number of entries in the TLS session cache, -1 to disable
+    int https_session_cache_size;
+    /// second lifetime of TLS session cache entries
+    int https_session_cache_ttl;
+    /// second lifetime of TLS session tickets, also the ticket key rotation
+    /// interval; -1 to disable session tickets
+    int https_ticket_lifetime;
+    /// millisecond idle timeout of a TLS connection between requests, kept
+    /// shorter than @a idle_timeout since every idle connection holds an ssl
+    /// context and its record buffers; a client that returns later resumes
+    /// from its session ticket. The record buffers themselves shrink with
+    /// the mbedtls options MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH and
+    /// MBEDTLS_SSL_MAX_FRAGMENT_LENGTH, or a smaller MBEDTLS_SSL_IN_CONTENT_LEN
+    /// and MBEDTLS_SSL_OUT_CONTENT_LEN
+    int https_keepalive_timeout;
+    /// hand TLS 1.2 AES-GCM and ChaCha20-Poly1305 record encryption to the
+    /// kernel after the handshake when nonzero, sessions the kernel cannot
+    /// take over stay in userspace
+    int https_ktls;
+    /// largest TLS 1.3 early data accepted from clients resuming with a
+    /// session ticket in bytes, 0 to refuse early data
+    int https_early_data;
+    /// IANA cipher suite ids in preference order, zero terminated; NULL for
+    /// the mbedtls defaults
+    const int *https_ciphersuites;
+    /// IANA named group ids in preference order (x25519 is 29, secp256r1 is
+    /// 23), zero terminated; NULL for the mbedtls defaults
+    const uint16_t *https_groups;
+    /// lowest accepted protocol version, 0 for the mbedtls default
+    int https_min_version;
+    /// highest accepted protocol version, 0 for the mbedtls default
+    int https_max_version;
+    /// random generator calls between reseeds of the per-thread generators,
+    /// 0 for the mbedtls default
+    int https_drbg_reseed_interval;
+    /// reseed from the entropy source before every generator call when
+    /// nonzero, slower but not predictable after a state compromise
+    int https_drbg_prediction_resistance;
 
     /// https server certificiate
     const void *https_crt;
@@ -51,6 +105,46 @@ struct ews_config {
 /// web server type
 typedef struct ews ews_t;
 
+/// web server statistics type
+typedef struct ews_stats ews_stats_t;
+
+/// web server statistics struct
+struct ews_stats {
+    /// connections accepted
+    uint32_t accepts;
+    /// bytes of session buffers held by connections, idle ones hold none
+    size_t session_buf;
+    /// bytes of released session buffers kept for reuse
+    size_t session_buf_pooled;
+    /// heap allocations of sessions and session buffers, flat under
+    /// connection churn once the pools are warm
+    uint32_t session_allocs;
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 || defined(__DOXYGEN__)
+    /// TLS sessions resumed from the session cache
+    uint32_t https_cache_hits;
+    /// TLS session ids presented by clients but not found in the cache
+    uint32_t https_cache_misses;
+    /// TLS sessions resumed from a session ticket
+    uint32_t https_ticket_hits;
+    /// TLS session tickets presented by clients but rejected
+    uint32_t https_ticket_misses;
+    /// TLS connections handed to kernel TLS
+    uint32_t https_ktls;
+    /// TLS connections that sent early data
+    uint32_t https_early_data;
+    /// TLS connections currently holding an ssl context
+    uint32_t https_tls_contexts;
+    /// bytes allocated through mbedtls, divide by @a https_tls_contexts for
+    /// the per-connection cost
+    size_t https_tls_mem;
+    /// peak of @a https_tls_mem
+    size_t https_tls_mem_peak;
+    /// bytes of released record buffers kept for reuse
+    size_t https_tls_mem_pooled;
+#endif
+};
+
 /// initialize and start web server
 /// @param[in] config server configuration struct
 /// @return web server instance
@@ -60,6 +154,11 @@ ews_t *ews_init(const ews_config_t *config);
 /// @param[in] ews web server instance
 void ews_destroy(ews_t *ews);
 
+/// get a snapshot of the web server statistics
+/// @param[in] ews web server instance
+/// @param[out] stats statistics
+void ews_get_stats(ews_t *ews, ews_stats_t *stats);
+
 #if CONFIG_EWS_HTTPS_CLIENTS > 0 || defined(__DOXYGEN__)
 /// add a client certificate and enable certificate checking
 /// @param[in] ews web server instance
@@ -67,6 +166,17 @@ void ews_destroy(ews_t *ews);
 /// @param[in] crt_len client certificate length
 /// @return @b true if successful, @b false otherwise
 bool ews_add_client_cert(ews_t *ews, const uint8_t *crt, size_t crt_len);
+
+/// route all mbedtls allocations in the process through a pool that keeps
+/// released record buffers for reuse; it has to be called before anything
+/// allocates through mbedtls, the first ews_init included
+/// @return @b true if the pool is installed, @b false if it is disabled or
+/// mbedtls is already in use
+bool ews_tls_mem_init(void);
+
+/// release the pooled buffers and restore the mbedtls allocator, the pool is
+/// kept while anything allocated through mbedtls is still live
+void ews_tls_mem_destroy(void);
 #endif
 
 /// @}
@@ -83,7 +193,12 @@ enum ews_sess_state  {
     EWS_SESS_REQUEST_BEGIN      =  0 | 0x00,
     /// request header: called once per request header
     EWS_SESS_REQUEST_HEADER     =  1 | 0x00,
-    /// request body: called until user reads or ignores all request data
+    /// request body: called until user reads or ignores all request data, a
+    /// call that reads none of the chunk ignores it; a client that expects
+    /// 100-continue is sent it only after a first call with an empty chunk
+    /// returns without an error or a pause, so a body rejected here or in
+    /// request header is never transferred; routes with
+    /// @a EWS_ROUTE_FLAG_NO_BODY are not called
     EWS_SESS_REQUEST_BODY       =  2 | 0x00,
 
     /// response begin: user sends http status
@@ -112,6 +227,15 @@ typedef struct ews_sess ews_sess_t;
 /// socket type
 typedef struct ews_sock ews_sock_t;
 
+/// response body producer type
+/// @param[in] sess session
+/// @param[in] arg producer argument
+/// @param[in] budget number of bytes that can be sent without queueing more
+///            than the high watermark
+/// @return @b true if more data follows, @b false when the body is complete
+typedef bool (*ews_sess_producer_t)(ews_sess_t *sess, void *arg,
+        size_t budget);
+
 /// session methods enum
 enum ews_sess_methods {
     EWS_SESS_METHOD_OTHER,
@@ -160,6 +284,38 @@ struct ews_sess_ops {
     /// @param[in] name header name
     /// @param[in] value header value
     void (*header)(ews_sess_t *sess, const char *name, const char *value);
+    /// stop reading the request body until resume is called, unconsumed
+    /// chunk data is presented again after resuming; a paused session is
+    /// subject to @a pause_timeout instead of the idle timeout
+    /// @param[in] sess session
+    /// @return token for resume, 0 outside the request body
+    uint32_t (*pause)(ews_sess_t *sess);
+    /// resume reading the request body, may be called from any thread; the
+    /// call is ignored once the paused request has finished, even if the
+    /// session already serves another one
+    /// @param[in] sess session
+    /// @param[in] token token returned by pause
+    void (*resume)(ews_sess_t *sess, uint32_t token);
+    /// hand the response body over to a producer, which is called only when
+    /// queued output drops below the low watermark; the route handler should
+    /// return @a EWS_ROUTE_STATUS_MORE afterwards
+    /// @param[in] sess session
+    /// @param[in] producer response body producer
+    /// @param[in] arg producer argument
+    void (*produce)(ews_sess_t *sess, ews_sess_producer_t producer, void *arg);
+    /// session send file contents, zero-copy on plain and kernel TLS
+    /// connections; requires a response with a content length
+    /// @param[in] sess session
+    /// @param[in] fd file descriptor
+    /// @param[in,out] offset file offset, advanced by the bytes sent
+    /// @param[in] len maximum number of bytes to send
+    /// @returns -1 on error, otherwise sent size
+    ssize_t (*sendfile)(ews_sess_t *sess, int fd, off_t *offset, size_t len);
+    /// allocate request scoped memory, all of it is released at finalize
+    /// @param[in] sess session
+    /// @param[in] size allocation size
+    /// @returns NULL if out of memory, otherwise memory aligned for any type
+    void *(*alloc)(ews_sess_t *sess, size_t size);
 };
 
 /// session data struct
@@ -194,6 +350,10 @@ struct ews_sess_data {
     };
     /// http request method
     uint8_t method;
+    /// well-known header id of name, only valid during request_header
+    uint8_t header_id;
+    /// request began in TLS 1.3 early data and may be a replay
+    bool early_data;
 };
 
 /// session struct
@@ -206,6 +366,32 @@ struct ews_sess {
     ews_sess_data_t data;
 };
 
+/// look up the id of a well-known header name, case insensitive
+/// @param[in] name header name
+/// @param[in] len header name length
+/// @return header id, @a EWS_HEADER_UNKNOWN for any other name
+ews_header_id_t ews_header_lookup(const char *name, size_t len);
+
+/// canonical spelling of a well-known header
+/// @param[in] id header id
+/// @return header name, NULL for @a EWS_HEADER_UNKNOWN
+const char *ews_header_name(ews_header_id_t id);
+
+/// look up a request header by name, case insensitive; the value points into
+/// the session buffer and is valid from the header's request_header state
+/// until finalize, whether or not the route handler was passed the header
+/// @param[in] sess session
+/// @param[in] name header name
+/// @return value of the first header with that name, NULL if there is none
+const char *ews_sess_get_header(ews_sess_t *sess, const char *name);
+
+/// look up a request trailer by name, case insensitive; trailers follow a
+/// chunked request body and are valid from response begin until finalize
+/// @param[in] sess session
+/// @param[in] name trailer name
+/// @return value of the first trailer with that name, NULL if there is none
+const char *ews_sess_get_trailer(ews_sess_t *sess, const char *name);
+
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
 /// @defgroup ews_routes Routes
@@ -235,6 +421,38 @@ enum ews_route_status {
     EWS_ROUTE_STATUS_MORE,
 };
 
+/// route flags type
+typedef enum ews_route_flags ews_route_flags_t;
+
+/// route flags enum
+enum ews_route_flags {
+    /// accept non-idempotent requests sent as TLS 1.3 early data, which are
+    /// otherwise answered with 425; the handler has to tolerate replays
+    EWS_ROUTE_FLAG_EARLY_DATA   = 1 << 0,
+    /// pass no request headers to the handler, implied by listing headers
+    /// in the route options
+    EWS_ROUTE_FLAG_NO_HEADERS   = 1 << 1,
+    /// pass no request body to the handler, it is discarded; a client that
+    /// expects 100-continue is answered right away and the connection is
+    /// closed after the response
+    EWS_ROUTE_FLAG_NO_BODY      = 1 << 2,
+};
+
+/// route options type
+typedef struct ews_route_opts ews_route_opts_t;
+
+/// route options struct
+struct ews_route_opts {
+    /// route flags
+    uint32_t flags;
+    /// well-known request headers passed to the handler, terminated by
+    /// @a EWS_HEADER_UNKNOWN
+    const ews_header_id_t *header_ids;
+    /// other request header names passed to the handler, case insensitive,
+    /// NULL terminated (not copied!)
+    const char *const *header_names;
+};
+
 /// route handler type
 typedef ews_route_status_t (*ews_route_handler_t)(ews_sess_t *sess,
         ews_sess_state_t state);
@@ -249,6 +467,20 @@ typedef ews_route_status_t (*ews_route_handler_t)(ews_sess_t *sess,
 bool ews_route_append(ews_t *ews, const char *pattern,
         ews_route_handler_t handler, size_t argc, ...);
 
+/// append a route with options to the list of route handlers; when the
+/// options list request headers, the handler sees only those in the
+/// request header state, all others are skipped
+/// @param[in] ews web sever instance
+/// @param[in] pattern a glob-like path matching string (not copied!)
+/// @param[in] handler a route handler
+/// @param[in] opts route options, NULL for none
+/// @param[in] argc the number of arguments to the route handler
+/// @param[inout] ... arguments passed to/from the route handler
+/// @return @b true if successful, @b false otherwise
+bool ews_route_append_ex(ews_t *ews, const char *pattern,
+        ews_route_handler_t handler, const ews_route_opts_t *opts,
+        size_t argc, ...);
+
 /// clear the list of route handlers
 /// @param[in] ews webs server instance
 void ews_route_clear(ews_t *ews);
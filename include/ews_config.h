@@ -30,14 +30,127 @@
 # define CONFIG_EWS_HTTPS_BACKLOG_DFLT ((CONFIG_EWS_HTTPS_CLIENTS) * 3 / 2)
 #endif
 
+#ifndef CONFIG_EWS_HTTPS_HANDSHAKES_DFLT
+# define CONFIG_EWS_HTTPS_HANDSHAKES_DFLT 8
+#endif
+
+#ifndef CONFIG_EWS_TLS_RECORD_MIN
+# define CONFIG_EWS_TLS_RECORD_MIN 1400
+#endif
+
+#ifndef CONFIG_EWS_TLS_RECORD_MAX
+# define CONFIG_EWS_TLS_RECORD_MAX 16384
+#endif
+
+#ifndef CONFIG_EWS_TLS_RECORD_BOOST
+# define CONFIG_EWS_TLS_RECORD_BOOST 65536
+#endif
+
+#ifndef CONFIG_EWS_TLS_RECORD_IDLE_MS
+# define CONFIG_EWS_TLS_RECORD_IDLE_MS 1000
+#endif
+
+#ifndef CONFIG_EWS_TLS_CTX_POOL
+# define CONFIG_EWS_TLS_CTX_POOL 8
+#endif
+
+#ifndef CONFIG_EWS_TLS_MEM_POOL
+# define CONFIG_EWS_TLS_MEM_POOL 16
+#endif
+
+#ifndef CONFIG_EWS_TLS_MEM_POOL_MIN
+# define CONFIG_EWS_TLS_MEM_POOL_MIN 4096
+#endif
+
+#ifndef CONFIG_EWS_TLS_MEM_CLASSES
+# define CONFIG_EWS_TLS_MEM_CLASSES 4
+#endif
+
+#ifndef CONFIG_EWS_KTLS
+# if defined(__linux__) && CONFIG_EWS_HTTPS_CLIENTS > 0
+#  define CONFIG_EWS_KTLS 1
+# else
+#  define CONFIG_EWS_KTLS 0
+# endif
+#endif
+
+#ifndef CONFIG_EWS_CRYPTO_THREADS
+# define CONFIG_EWS_CRYPTO_THREADS 2
+#endif
+
+#ifndef CONFIG_EWS_CRYPTO_STACK_SIZE
+# define CONFIG_EWS_CRYPTO_STACK_SIZE 4096
+#endif
+
+#ifndef CONFIG_EWS_HTTPS_SESSION_CACHE_DFLT
+# define CONFIG_EWS_HTTPS_SESSION_CACHE_DFLT 50
+#endif
+
+#ifndef CONFIG_EWS_HTTPS_SESSION_TTL_DFLT
+# define CONFIG_EWS_HTTPS_SESSION_TTL_DFLT 3600
+#endif
+
+#ifndef CONFIG_EWS_HTTPS_TICKET_LIFETIME_DFLT
+# define CONFIG_EWS_HTTPS_TICKET_LIFETIME_DFLT 3600
+#endif
+
 #ifndef CONFIG_EWS_IDLE_TIMEOUT_DFLT
 # define CONFIG_EWS_IDLE_TIMEOUT_DFLT 15000
 #endif
 
+#ifndef CONFIG_EWS_PAUSE_TIMEOUT_DFLT
+# define CONFIG_EWS_PAUSE_TIMEOUT_DFLT 300000
+#endif
+
+#ifndef CONFIG_EWS_HTTPS_KEEPALIVE_TIMEOUT_DFLT
+# define CONFIG_EWS_HTTPS_KEEPALIVE_TIMEOUT_DFLT 5000
+#endif
+
+/// Server response header value unless configured otherwise
+#ifndef CONFIG_EWS_SERVER_NAME
+# define CONFIG_EWS_SERVER_NAME "acews"
+#endif
+
+/// longest Server response header value, longer ones are cut
+#ifndef CONFIG_EWS_SERVER_NAME_MAX
+# define CONFIG_EWS_SERVER_NAME_MAX 64
+#endif
+
+/// session buffer size on the first read of a request
 #ifndef CONFIG_EWS_SESSION_BUFSIZE
 # define CONFIG_EWS_SESSION_BUFSIZE 2048
 #endif
 
+/// largest session buffer, bounds the request line and header block; the
+/// buffer is promoted through 8, 16 and 64 KiB as far as this allows
+#ifndef CONFIG_EWS_SESSION_BUFSIZE_MAX
+# define CONFIG_EWS_SESSION_BUFSIZE_MAX 65536
+#endif
+
+/// released session buffers kept for reuse, per size
+#ifndef CONFIG_EWS_SESSION_BUF_POOL
+# define CONFIG_EWS_SESSION_BUF_POOL 16
+#endif
+
+/// request headers kept for ews_sess_get_header, any more are only passed
+/// to the route handler; the table grows in the request arena
+#ifndef CONFIG_EWS_SESSION_HEADERS
+# define CONFIG_EWS_SESSION_HEADERS 32
+#endif
+
+/// SSE2/AVX2/NEON request parsing scanners, picked at runtime
+#ifndef CONFIG_EWS_SIMD
+# define CONFIG_EWS_SIMD 1
+#endif
+
+#ifndef CONFIG_EWS_SEND_LOWAT
+# define CONFIG_EWS_SEND_LOWAT 16384
+#endif
+
+#ifndef CONFIG_EWS_SEND_HIWAT
+# define CONFIG_EWS_SEND_HIWAT ((CONFIG_EWS_SEND_LOWAT) * 2)
+#endif
+
 // #ifndef CONFIG_EWS_REQ_CHUNKED
 // # define CONFIG_EWS_REQ_CHUNKED 1
 // #endif
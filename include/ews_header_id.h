@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: MIT
+// generated by tools/header_ids.py, do not edit
+#pragma once
+
+
+/// well-known header id type
+typedef enum ews_header_id ews_header_id_t;
+
+/// well-known header id enum
+enum ews_header_id {
+    EWS_HEADER_UNKNOWN,
+    EWS_HEADER_ACCEPT,
+    EWS_HEADER_ACCEPT_CHARSET,
+    EWS_HEADER_ACCEPT_ENCODING,
+    EWS_HEADER_ACCEPT_LANGUAGE,
+    EWS_HEADER_ACCESS_CONTROL_REQUEST_HEADERS,
+    EWS_HEADER_ACCESS_CONTROL_REQUEST_METHOD,
+    EWS_HEADER_AUTHORIZATION,
+    EWS_HEADER_CACHE_CONTROL,
+    EWS_HEADER_CONNECTION,
+    EWS_HEADER_CONTENT_DISPOSITION,
+    EWS_HEADER_CONTENT_ENCODING,
+    EWS_HEADER_CONTENT_LENGTH,
+    EWS_HEADER_CONTENT_TYPE,
+    EWS_HEADER_COOKIE,
+    EWS_HEADER_DNT,
+    EWS_HEADER_DATE,
+    EWS_HEADER_EXPECT,
+    EWS_HEADER_FORWARDED,
+    EWS_HEADER_HOST,
+    EWS_HEADER_IF_MATCH,
+    EWS_HEADER_IF_MODIFIED_SINCE,
+    EWS_HEADER_IF_NONE_MATCH,
+    EWS_HEADER_IF_RANGE,
+    EWS_HEADER_IF_UNMODIFIED_SINCE,
+    EWS_HEADER_KEEP_ALIVE,
+    EWS_HEADER_ORIGIN,
+    EWS_HEADER_PRAGMA,
+    EWS_HEADER_PRIORITY,
+    EWS_HEADER_RANGE,
+    EWS_HEADER_REFERER,
+    EWS_HEADER_SEC_FETCH_DEST,
+    EWS_HEADER_SEC_FETCH_MODE,
+    EWS_HEADER_SEC_FETCH_SITE,
+    EWS_HEADER_SEC_FETCH_USER,
+    EWS_HEADER_SEC_WEBSOCKET_EXTENSIONS,
+    EWS_HEADER_SEC_WEBSOCKET_KEY,
+    EWS_HEADER_SEC_WEBSOCKET_PROTOCOL,
+    EWS_HEADER_SEC_WEBSOCKET_VERSION,
+    EWS_HEADER_TE,
+    EWS_HEADER_TRAILER,
+    EWS_HEADER_TRANSFER_ENCODING,
+    EWS_HEADER_UPGRADE,
+    EWS_HEADER_UPGRADE_INSECURE_REQUESTS,
+    EWS_HEADER_USER_AGENT,
+    EWS_HEADER_VIA,
+    EWS_HEADER_X_FORWARDED_FOR,
+    EWS_HEADER_X_FORWARDED_HOST,
+    EWS_HEADER_X_FORWARDED_PROTO,
+    EWS_HEADER_X_REQUESTED_WITH,
+    EWS_HEADER_COUNT,
+};
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "ews_port.h"
+
+
+void *ews_arena_alloc_slow(ews_arena_t *arena, ews_bufpool_t *pool,
+        size_t size)
+{
+    ews_arena_chunk_t *chunk = NULL;
+    size_t chunk_size;
+    uint8_t *p;
+
+    /// the smallest tier that fits
+    for (unsigned int tier = 0; (chunk_size = ews_bufpool_size(tier)) > 0;
+            tier++) {
+        if (chunk_size - sizeof(*chunk) < size) {
+            continue;
+        }
+        chunk = (ews_arena_chunk_t *) ews_bufpool_get(pool, tier);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->tier = tier;
+        break;
+    }
+
+    if (chunk == NULL) {
+        if (size > SIZE_MAX - sizeof(*chunk)) {
+            return NULL;
+        }
+        chunk_size = sizeof(*chunk) + size;
+        chunk = malloc(chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        pool->allocs++;
+        chunk->tier = UINT8_MAX;
+    }
+
+    chunk->next = arena->chunk;
+    arena->chunk = chunk;
+
+    p = (uint8_t *) (chunk + 1);
+    arena->pos = p + size;
+    arena->end = (uint8_t *) chunk + chunk_size;
+    return p;
+}
+
+void ews_arena_reset(ews_arena_t *arena, ews_bufpool_t *pool)
+{
+    while (arena->chunk) {
+        ews_arena_chunk_t *chunk = arena->chunk;
+        arena->chunk = chunk->next;
+        if (chunk->tier == UINT8_MAX) {
+            free(chunk);
+        } else {
+            ews_bufpool_put(pool, (uint8_t *) chunk, chunk->tier);
+        }
+    }
+    arena->pos = NULL;
+    arena->end = NULL;
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bufpool.h"
+
+
+typedef struct ews_arena ews_arena_t;
+typedef union ews_arena_chunk ews_arena_chunk_t;
+
+/// chunk header, chunks are pooled session buffers or, for allocations
+/// larger than the largest tier, heap blocks
+union ews_arena_chunk {
+    struct {
+        ews_arena_chunk_t *next;
+        /// buffer tier, UINT8_MAX for heap blocks
+        uint8_t tier;
+    };
+    max_align_t align;
+};
+
+/// bump allocator released as a whole
+struct ews_arena {
+    ews_arena_chunk_t *chunk;
+    uint8_t *pos;
+    uint8_t *end;
+};
+
+/// allocate from a new chunk, for when the current one is full
+void *ews_arena_alloc_slow(ews_arena_t *arena, ews_bufpool_t *pool,
+        size_t size);
+
+/// give all chunks back
+void ews_arena_reset(ews_arena_t *arena, ews_bufpool_t *pool);
+
+/// allocate memory aligned for any type, valid until the next reset
+/// @return NULL if out of memory
+static inline void *ews_arena_alloc(ews_arena_t *arena, ews_bufpool_t *pool,
+        size_t size)
+{
+    uint8_t *p = arena->pos;
+
+    /// rounding up would wrap around to a small size
+    if (size > SIZE_MAX - (_Alignof(max_align_t) - 1)) {
+        return NULL;
+    }
+    size = (size + _Alignof(max_align_t) - 1) &
+            ~(_Alignof(max_align_t) - 1);
+    if (p == NULL || size > (size_t) (arena->end - p)) {
+        return ews_arena_alloc_slow(arena, pool, size);
+    }
+    arena->pos = p + size;
+    return p;
+}
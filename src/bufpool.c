@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bufpool.h"
+#include "ews_port.h"
+
+
+/// a small first tier for typical requests, larger ones for long cookies and
+/// tokens, up to the configured maximum
+static const size_t bufpool_sizes[] = {
+    CONFIG_EWS_SESSION_BUFSIZE,
+#if CONFIG_EWS_SESSION_BUFSIZE < 8192 && CONFIG_EWS_SESSION_BUFSIZE_MAX >= 8192
+    8192,
+#endif
+#if CONFIG_EWS_SESSION_BUFSIZE < 16384 && \
+        CONFIG_EWS_SESSION_BUFSIZE_MAX >= 16384
+    16384,
+#endif
+#if CONFIG_EWS_SESSION_BUFSIZE < 65536 && \
+        CONFIG_EWS_SESSION_BUFSIZE_MAX >= 65536
+    65536,
+#endif
+};
+
+_Static_assert(countof(bufpool_sizes) <= EWS_BUFPOOL_TIERS,
+        "too many buffer tiers");
+
+void ews_bufpool_destroy(ews_bufpool_t *pool)
+{
+    for (int i = 0; i < countof(pool->tier); i++) {
+        while (pool->tier[i].head) {
+            ews_bufpool_free_t *f = pool->tier[i].head;
+            pool->tier[i].head = f->next;
+            free(f);
+        }
+        pool->tier[i].count = 0;
+    }
+    pool->pooled = 0;
+}
+
+size_t ews_bufpool_size(unsigned int tier)
+{
+    if (tier >= countof(bufpool_sizes)) {
+        return 0;
+    }
+    return bufpool_sizes[tier];
+}
+
+uint8_t *ews_bufpool_get(ews_bufpool_t *pool, unsigned int tier)
+{
+    size_t size = ews_bufpool_size(tier);
+    uint8_t *buf;
+
+    if (size == 0) {
+        return NULL;
+    }
+
+    if (pool->tier[tier].head) {
+        buf = (uint8_t *) pool->tier[tier].head;
+        pool->tier[tier].head = pool->tier[tier].head->next;
+        pool->tier[tier].count--;
+        pool->pooled -= size;
+    } else {
+        /// buffers are not cleared, sessions only read what they received
+        buf = malloc(size);
+        if (buf == NULL) {
+            return NULL;
+        }
+        pool->allocs++;
+    }
+
+    pool->used += size;
+    return buf;
+}
+
+void ews_bufpool_put(ews_bufpool_t *pool, uint8_t *buf, unsigned int tier)
+{
+    size_t size = ews_bufpool_size(tier);
+
+    if (buf == NULL) {
+        return;
+    }
+
+    pool->used -= size;
+    if (pool->tier[tier].count >= CONFIG_EWS_SESSION_BUF_POOL) {
+        free(buf);
+        return;
+    }
+
+    ews_bufpool_free_t *f = (ews_bufpool_free_t *) buf;
+    f->next = pool->tier[tier].head;
+    pool->tier[tier].head = f;
+    pool->tier[tier].count++;
+    pool->pooled += size;
+}
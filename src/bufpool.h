@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ews_config.h"
+
+
+#define EWS_BUFPOOL_TIERS 4
+
+typedef struct ews_bufpool ews_bufpool_t;
+typedef struct ews_bufpool_free ews_bufpool_free_t;
+
+struct ews_bufpool_free {
+    ews_bufpool_free_t *next;
+};
+
+/// session buffers of a few fixed sizes, only touched by the worker thread
+struct ews_bufpool {
+    struct {
+        ews_bufpool_free_t *head;
+        int count;
+    } tier[EWS_BUFPOOL_TIERS];
+    /// bytes held by sessions
+    size_t used;
+    /// bytes of released buffers kept for reuse
+    size_t pooled;
+    /// buffers allocated from the heap
+    uint32_t allocs;
+};
+
+/// free all pooled buffers
+void ews_bufpool_destroy(ews_bufpool_t *pool);
+
+/// size of the buffers of a tier
+/// @return 0 past the largest tier
+size_t ews_bufpool_size(unsigned int tier);
+
+/// take a buffer of a tier from the pool, or allocate one
+/// @return NULL if out of memory
+uint8_t *ews_bufpool_get(ews_bufpool_t *pool, unsigned int tier);
+
+/// give a buffer back to the pool, or free it if the tier is full
+void ews_bufpool_put(ews_bufpool_t *pool, uint8_t *buf, unsigned int tier);
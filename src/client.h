@@ -13,15 +13,43 @@
 
 typedef struct ews_client ews_client_t;
 typedef struct ews_client_tls ews_client_tls_t;
+typedef struct ews_tls_ctx ews_tls_ctx_t;
 
 struct ews_client {
     ews_sock_t sock;
 };
 
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
+/// ssl context with the server it belongs to, for mbedtls callbacks
+struct ews_tls_ctx {
+    mbedtls_ssl_context ssl;
+    ews_t *ews;
+    ews_tls_ctx_t *next;
+};
+
 struct ews_client_tls {
     ews_sock_t sock;
-    ews_thread_t thread;
-    mbedtls_ssl_context ssl_ctx;
+    int handshake_want;
+    /// ssl context from the context pool, NULL once kTLS took over
+    mbedtls_ssl_context *ssl;
+    /// TLS 1.3 early data received during the handshake, read first
+    unsigned char *early_buf;
+    size_t early_pos;
+    size_t early_len;
+
+    /// plaintext waiting to be sealed into records, taken from the pool on
+    /// the first write and returned once a flush drains it
+    uint8_t *out_buf;
+    size_t out_pos;
+    size_t out_len;
+    /// length of a record mbedtls_ssl_write has to be retried with
+    size_t out_retry;
+    size_t record_size;
+    size_t record_bytes;
+    uint32_t record_last;
+#if CONFIG_EWS_KTLS
+    /// key material captured during the handshake, until kTLS is installed
+    struct ews_ktls_keys *ktls;
+#endif
 };
 #endif
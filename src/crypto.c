@@ -0,0 +1,318 @@
+// SPDX-License-Identifier: MIT
+#include <stdbool.h>
+#include <string.h>
+
+#include "ews_config.h"
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+# include <mbedtls/pk.h>
+# include <mbedtls/ssl.h>
+#endif
+
+#include "crypto.h"
+#include "client.h"
+#include "ews_port.h"
+#include "server.h"
+
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 && CONFIG_EWS_CRYPTO_THREADS > 0
+# if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+static ews_t *crypto_ews(mbedtls_ssl_context *ssl)
+{
+    ews_tls_ctx_t *ctx = container_of(ssl, ews_tls_ctx_t, ssl);
+
+    return ctx->ews;
+}
+
+static void crypto_run(ews_crypto_thread_t *thread, ews_crypto_job_t *job)
+{
+    ews_t *ews = job->ews;
+
+    if (job->decrypt) {
+        job->ret = mbedtls_pk_decrypt(&thread->pk, job->input,
+                job->input_len, job->output, &job->output_len,
+                sizeof(job->output), ews_tls_random, ews);
+        return;
+    }
+
+#  if MBEDTLS_VERSION_MAJOR < 3
+    job->ret = mbedtls_pk_sign(&thread->pk, job->md_alg, job->input,
+            job->input_len, job->output, &job->output_len, ews_tls_random,
+            ews);
+#  else
+    job->ret = mbedtls_pk_sign(&thread->pk, job->md_alg, job->input,
+            job->input_len, job->output, sizeof(job->output),
+            &job->output_len, ews_tls_random, ews);
+#  endif
+}
+
+static void crypto_task(void *arg)
+{
+    ews_crypto_thread_t *thread = arg;
+    ews_t *ews = thread->ews;
+    ews_crypto_pool_t *pool = &ews->tls.crypto;
+    ews_crypto_job_t *job;
+
+    ews_tls_drbg_bind(&thread->drbg);
+
+    while (true) {
+        ews_semaphore_take(&pool->semaphore, UINT32_MAX);
+
+        ews_mutex_lock(&pool->mutex);
+        if (pool->shutdown) {
+            ews_mutex_unlock(&pool->mutex);
+            break;
+        }
+        job = pool->head;
+        if (job == NULL) {
+            ews_mutex_unlock(&pool->mutex);
+            continue;
+        }
+        pool->head = job->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        job->state = EWS_CRYPTO_JOB_RUNNING;
+        ews_mutex_unlock(&pool->mutex);
+
+        if (!job->cancelled) {
+            crypto_run(thread, job);
+        }
+
+        ews_mutex_lock(&pool->mutex);
+        if (job->cancelled) {
+            free(job);
+        } else {
+            __atomic_store_n(&job->state, EWS_CRYPTO_JOB_DONE,
+                    __ATOMIC_RELEASE);
+            ews_worker_wake(&ews->worker);
+        }
+        ews_mutex_unlock(&pool->mutex);
+    }
+
+    ews_tls_drbg_bind(NULL);
+}
+
+static bool crypto_parse_key(ews_t *ews, mbedtls_pk_context *pk)
+{
+    int ret;
+
+    mbedtls_pk_init(pk);
+#  if MBEDTLS_VERSION_MAJOR < 3
+    ret = mbedtls_pk_parse_key(pk, ews->config.https_pk,
+            ews->config.https_pk_len, NULL, 0);
+#  else
+    ret = mbedtls_pk_parse_key(pk, ews->config.https_pk,
+            ews->config.https_pk_len, NULL, 0, ews_tls_random, ews);
+#  endif
+    if (ret < 0) {
+        LOGE("mbedtls_pk_parse_key failed");
+        mbedtls_pk_free(pk);
+        return false;
+    }
+    return true;
+}
+
+static int crypto_start(mbedtls_ssl_context *ssl, ews_t *ews,
+        ews_crypto_job_t *job)
+{
+    ews_crypto_pool_t *pool = &ews->tls.crypto;
+
+    job->ews = ews;
+    job->state = EWS_CRYPTO_JOB_QUEUED;
+    mbedtls_ssl_set_async_operation_data(ssl, job);
+
+    ews_mutex_lock(&pool->mutex);
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    ews_mutex_unlock(&pool->mutex);
+
+    ews_semaphore_give(&pool->semaphore);
+    return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+}
+
+static int crypto_sign_start(mbedtls_ssl_context *ssl, mbedtls_x509_crt *cert,
+        mbedtls_md_type_t md_alg, const unsigned char *hash, size_t hash_len)
+{
+    ews_t *ews = crypto_ews(ssl);
+    ews_crypto_job_t *job;
+
+    if (hash_len > sizeof(job->input)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    job->md_alg = md_alg;
+    job->input_len = hash_len;
+    memcpy(job->input, hash, hash_len);
+
+    return crypto_start(ssl, ews, job);
+}
+
+static int crypto_decrypt_start(mbedtls_ssl_context *ssl,
+        mbedtls_x509_crt *cert, const unsigned char *input, size_t input_len)
+{
+    ews_t *ews = crypto_ews(ssl);
+    ews_crypto_job_t *job;
+
+    if (input_len > sizeof(job->input)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (job == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    job->decrypt = true;
+    job->input_len = input_len;
+    memcpy(job->input, input, input_len);
+
+    return crypto_start(ssl, ews, job);
+}
+
+static int crypto_resume(mbedtls_ssl_context *ssl, unsigned char *output,
+        size_t *output_len, size_t output_size)
+{
+    ews_crypto_job_t *job = mbedtls_ssl_get_async_operation_data(ssl);
+    int ret;
+
+    if (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) !=
+            EWS_CRYPTO_JOB_DONE) {
+        return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+    }
+
+    ret = job->ret;
+    if (ret == 0) {
+        if (job->output_len > output_size) {
+            ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        } else {
+            memcpy(output, job->output, job->output_len);
+            *output_len = job->output_len;
+        }
+    }
+
+    mbedtls_ssl_set_async_operation_data(ssl, NULL);
+    free(job);
+    return ret;
+}
+
+static void crypto_cancel(mbedtls_ssl_context *ssl)
+{
+    ews_crypto_job_t *job = mbedtls_ssl_get_async_operation_data(ssl);
+    ews_crypto_pool_t *pool = &job->ews->tls.crypto;
+
+    /// a job still in the queue or running is freed by the crypto thread
+    ews_mutex_lock(&pool->mutex);
+    if (job->state == EWS_CRYPTO_JOB_DONE) {
+        free(job);
+    } else {
+        job->cancelled = true;
+    }
+    ews_mutex_unlock(&pool->mutex);
+
+    mbedtls_ssl_set_async_operation_data(ssl, NULL);
+}
+# endif
+
+bool ews_crypto_init(ews_t *ews)
+{
+# if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    ews_crypto_pool_t *pool = &ews->tls.crypto;
+
+    ews_mutex_init(&pool->mutex, false);
+    if (!ews_semaphore_init(&pool->semaphore, INT32_MAX, 0)) {
+        LOGE("ews_semaphore_init failed");
+        ews_mutex_destroy(&pool->mutex);
+        return false;
+    }
+
+    for (int i = 0; i < countof(pool->threads); i++) {
+        ews_crypto_thread_t *thread = &pool->threads[i];
+
+        thread->ews = ews;
+        if (!ews_tls_drbg_seed(ews, &thread->drbg)) {
+            break;
+        }
+        if (!crypto_parse_key(ews, &thread->pk)) {
+            mbedtls_ctr_drbg_free(&thread->drbg);
+            break;
+        }
+        if (!ews_thread_init(&thread->thread, crypto_task, thread,
+                CONFIG_EWS_CRYPTO_STACK_SIZE)) {
+            mbedtls_pk_free(&thread->pk);
+            mbedtls_ctr_drbg_free(&thread->drbg);
+            break;
+        }
+        pool->num_threads++;
+    }
+    if (pool->num_threads == 0) {
+        ews_sempaphore_destroy(&pool->semaphore);
+        ews_mutex_destroy(&pool->mutex);
+        return false;
+    }
+
+    mbedtls_ssl_conf_async_private_cb(&ews->tls.ssl_cfg, crypto_sign_start,
+            crypto_decrypt_start, crypto_resume, crypto_cancel, ews);
+# else
+    LOGW("MBEDTLS_SSL_ASYNC_PRIVATE disabled, signing on the worker");
+# endif
+    return true;
+}
+
+void ews_crypto_destroy(ews_t *ews)
+{
+    ews_crypto_pool_t *pool = &ews->tls.crypto;
+    ews_crypto_job_t *job;
+
+    if (pool->num_threads == 0) {
+        return;
+    }
+
+    ews_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    ews_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->num_threads; i++) {
+        ews_semaphore_give(&pool->semaphore);
+    }
+
+    /// the threads use the key, drbgs and config released by tls_free
+    for (int i = 0; i < pool->num_threads; i++) {
+        ews_crypto_thread_t *thread = &pool->threads[i];
+
+        ews_thread_join(&thread->thread);
+        mbedtls_pk_free(&thread->pk);
+        mbedtls_ctr_drbg_free(&thread->drbg);
+    }
+    pool->num_threads = 0;
+
+    /// jobs nobody picked up, the worker has stopped and will not resume them
+    while ((job = pool->head) != NULL) {
+        pool->head = job->next;
+        free(job);
+    }
+    pool->tail = NULL;
+
+    ews_sempaphore_destroy(&pool->semaphore);
+    ews_mutex_destroy(&pool->mutex);
+}
+
+bool ews_crypto_done(mbedtls_ssl_context *ssl)
+{
+# if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    ews_crypto_job_t *job = mbedtls_ssl_get_async_operation_data(ssl);
+
+    return job == NULL ||
+            __atomic_load_n(&job->state, __ATOMIC_ACQUIRE) ==
+            EWS_CRYPTO_JOB_DONE;
+# else
+    return true;
+# endif
+}
+#endif
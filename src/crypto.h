@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ews_config.h"
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+# include <mbedtls/ctr_drbg.h>
+# include <mbedtls/pk.h>
+# include <mbedtls/ssl.h>
+#endif
+
+#include "ews.h"
+#include "ews_port.h"
+
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 && CONFIG_EWS_CRYPTO_THREADS > 0
+typedef struct ews_crypto_job ews_crypto_job_t;
+typedef struct ews_crypto_pool ews_crypto_pool_t;
+typedef struct ews_crypto_thread ews_crypto_thread_t;
+typedef enum ews_crypto_job_state ews_crypto_job_state_t;
+
+enum ews_crypto_job_state {
+    EWS_CRYPTO_JOB_QUEUED,
+    EWS_CRYPTO_JOB_RUNNING,
+    EWS_CRYPTO_JOB_DONE,
+};
+
+/// private key operation, owned by the crypto pool from start until resume
+struct ews_crypto_job {
+    ews_crypto_job_t *next;
+    ews_t *ews;
+    uint8_t state;
+    bool decrypt;
+    bool cancelled;
+    int ret;
+    mbedtls_md_type_t md_alg;
+    size_t input_len;
+    size_t output_len;
+    unsigned char input[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+    unsigned char output[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+};
+
+/// each thread signs with its own copy of the key, a pk context is not
+/// safe to use from several threads at once
+struct ews_crypto_thread {
+    ews_thread_t thread;
+    ews_t *ews;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_pk_context pk;
+};
+
+struct ews_crypto_pool {
+    ews_mutex_t mutex;
+    ews_semaphore_t semaphore;
+    ews_crypto_job_t *head;
+    ews_crypto_job_t *tail;
+    ews_crypto_thread_t threads[CONFIG_EWS_CRYPTO_THREADS];
+    int num_threads;
+    bool shutdown;
+};
+
+bool ews_crypto_init(ews_t *ews);
+void ews_crypto_destroy(ews_t *ews);
+bool ews_crypto_done(mbedtls_ssl_context *ssl);
+#endif
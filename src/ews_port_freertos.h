@@ -6,6 +6,11 @@ extern "C" {
 #endif
 
 #include <assert.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #define INC_STR(x) __INC_STR(x)
 #define __INC_STR(x) #x
@@ -186,6 +191,7 @@ typedef void (*ews_thread_func_t)(void *arg);
 /// thread struct
 struct ews_thread {
     TaskHandle_t handle;
+    StaticSemaphore_t exited;
     ews_thread_func_t func;
     void *arg;
 };
@@ -200,7 +206,9 @@ static void thread_wrapper(void *arg)
 
     thread->func(thread->arg);
 
-    ews_thread_destroy(thread);
+    /// the joiner may release @a thread once this is given
+    xSemaphoreGive((SemaphoreHandle_t) &thread->exited);
+    vTaskDelete(NULL);
 }
 /// @endinternal
 
@@ -217,6 +225,7 @@ static inline int ews_thread_init(ews_thread_t *thread, ews_thread_func_t func,
 
     thread->func = func;
     thread->arg = arg;
+    xSemaphoreCreateBinaryStatic(&thread->exited);
 
     return xTaskCreate(thread_wrapper, "ews", stack_words, thread,
             tskIDLE_PRIORITY + 1, &thread->handle) == pdPASS;
@@ -235,6 +244,15 @@ static inline void ews_thread_destroy(ews_thread_t *thread)
     }
 }
 
+/// wait for a thread to return from its function
+/// @param[in] thread pointer to ews_thread
+static inline void ews_thread_join(ews_thread_t *thread)
+{
+    assert(thread != NULL);
+
+    xSemaphoreTake((SemaphoreHandle_t) &thread->exited, portMAX_DELAY);
+}
+
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
 /// @defgroup ews_timers Portable timers
@@ -314,6 +332,93 @@ static inline void ews_timer_stop(ews_timer_t *timer)
     xTimerStop(timer->handle, portMAX_DELAY);
 }
 
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+/// @defgroup ews_wakes Portable select wakeups
+/// @{
+
+/// wake typedef
+typedef struct ews_wake ews_wake_t;
+
+/// @internal
+/// wake struct
+struct ews_wake {
+    int fd;
+    struct sockaddr_in addr;
+};
+/// @endinternal
+
+/// initialize a wake
+/// @param[in] wake pointer to ews_wake
+/// @return 1 on success or 0 on failure
+static inline int ews_wake_init(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    socklen_t socklen = sizeof(wake->addr);
+
+    /// lwip has no pipes, so loop a datagram socket back to itself
+    wake->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake->fd < 0) {
+        LOGE("socket failed");
+        return 0;
+    }
+
+    memset(&wake->addr, 0, sizeof(wake->addr));
+    wake->addr.sin_family = AF_INET;
+    wake->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(wake->fd, (struct sockaddr *) &wake->addr, socklen) < 0 ||
+            getsockname(wake->fd, (struct sockaddr *) &wake->addr,
+            &socklen) < 0) {
+        LOGE("bind failed");
+        close(wake->fd);
+        return 0;
+    }
+    fcntl(wake->fd, F_SETFL, fcntl(wake->fd, F_GETFL) | O_NONBLOCK);
+    return 1;
+}
+
+/// tear down a wake
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_destroy(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    close(wake->fd);
+}
+
+/// get the file descriptor to select for read
+/// @param[in] wake pointer to ews_wake
+/// @return file descriptor
+static inline int ews_wake_fd(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    return wake->fd;
+}
+
+/// wake a thread blocked in select, may be called from any thread
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_signal(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    sendto(wake->fd, "", 1, 0, (struct sockaddr *) &wake->addr,
+            sizeof(wake->addr));
+}
+
+/// acknowledge all pending wakeups
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_clear(ews_wake_t *wake)
+{
+    uint8_t buf[16];
+
+    assert(wake != NULL);
+
+    while (recv(wake->fd, buf, sizeof(buf), 0) > 0) {
+    }
+}
+
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
@@ -124,10 +125,10 @@ static inline int ews_semaphore_init(ews_semaphore_t *semaphore, uint32_t max,
 {
     semaphore->max = max;
     if (sem_init(&semaphore->semaphore, 0, initial)) {
-        return 1;
+        return 0;
     }
 
-    return 0;
+    return 1;
 }
 
 /// tear down a semaphore
@@ -270,6 +271,15 @@ static inline void ews_thread_destroy(ews_thread_t *thread)
     }
 }
 
+/// wait for a thread to return from its function
+/// @param[in] thread pointer to ews_thread
+static inline void ews_thread_join(ews_thread_t *thread)
+{
+    assert(thread != NULL);
+
+    pthread_join(thread->pthread, NULL);
+}
+
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
 /// @defgroup ews_timers Portable timers
@@ -368,6 +378,81 @@ static inline void ews_timer_stop(ews_timer_t *timer)
     }
 }
 
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+/// @defgroup ews_wakes Portable select wakeups
+/// @{
+
+/// wake typedef
+typedef struct ews_wake ews_wake_t;
+
+/// @internal
+/// wake struct
+struct ews_wake {
+    int fds[2];
+};
+/// @endinternal
+
+/// initialize a wake
+/// @param[in] wake pointer to ews_wake
+/// @return 1 on success or 0 on failure
+static inline int ews_wake_init(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    if (pipe(wake->fds) < 0) {
+        LOGE("pipe failed");
+        return 0;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(wake->fds[i], F_SETFL, fcntl(wake->fds[i], F_GETFL) | O_NONBLOCK);
+    }
+    return 1;
+}
+
+/// tear down a wake
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_destroy(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    close(wake->fds[0]);
+    close(wake->fds[1]);
+}
+
+/// get the file descriptor to select for read
+/// @param[in] wake pointer to ews_wake
+/// @return file descriptor
+static inline int ews_wake_fd(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    return wake->fds[0];
+}
+
+/// wake a thread blocked in select, may be called from any thread
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_signal(ews_wake_t *wake)
+{
+    assert(wake != NULL);
+
+    if (write(wake->fds[1], "", 1) < 0) {
+        /// pipe is full, a wakeup is already pending
+    }
+}
+
+/// acknowledge all pending wakeups
+/// @param[in] wake pointer to ews_wake
+static inline void ews_wake_clear(ews_wake_t *wake)
+{
+    uint8_t buf[16];
+
+    assert(wake != NULL);
+
+    while (read(wake->fds[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+// generated by tools/header_ids.py, do not edit
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ews.h"
+
+
+#define HEADER_BITS 7
+#define HEADER_SEED 0x9BEEE64D382FD485ull
+#define HEADER_MIX 0x9E3779B97F4A7C15ull
+
+static const char *const header_names[EWS_HEADER_COUNT] = {
+    [EWS_HEADER_UNKNOWN] = NULL,
+    [EWS_HEADER_ACCEPT] = "Accept",
+    [EWS_HEADER_ACCEPT_CHARSET] = "Accept-Charset",
+    [EWS_HEADER_ACCEPT_ENCODING] = "Accept-Encoding",
+    [EWS_HEADER_ACCEPT_LANGUAGE] = "Accept-Language",
+    [EWS_HEADER_ACCESS_CONTROL_REQUEST_HEADERS] = "Access-Control-Request-Headers",
+    [EWS_HEADER_ACCESS_CONTROL_REQUEST_METHOD] = "Access-Control-Request-Method",
+    [EWS_HEADER_AUTHORIZATION] = "Authorization",
+    [EWS_HEADER_CACHE_CONTROL] = "Cache-Control",
+    [EWS_HEADER_CONNECTION] = "Connection",
+    [EWS_HEADER_CONTENT_DISPOSITION] = "Content-Disposition",
+    [EWS_HEADER_CONTENT_ENCODING] = "Content-Encoding",
+    [EWS_HEADER_CONTENT_LENGTH] = "Content-Length",
+    [EWS_HEADER_CONTENT_TYPE] = "Content-Type",
+    [EWS_HEADER_COOKIE] = "Cookie",
+    [EWS_HEADER_DNT] = "DNT",
+    [EWS_HEADER_DATE] = "Date",
+    [EWS_HEADER_EXPECT] = "Expect",
+    [EWS_HEADER_FORWARDED] = "Forwarded",
+    [EWS_HEADER_HOST] = "Host",
+    [EWS_HEADER_IF_MATCH] = "If-Match",
+    [EWS_HEADER_IF_MODIFIED_SINCE] = "If-Modified-Since",
+    [EWS_HEADER_IF_NONE_MATCH] = "If-None-Match",
+    [EWS_HEADER_IF_RANGE] = "If-Range",
+    [EWS_HEADER_IF_UNMODIFIED_SINCE] = "If-Unmodified-Since",
+    [EWS_HEADER_KEEP_ALIVE] = "Keep-Alive",
+    [EWS_HEADER_ORIGIN] = "Origin",
+    [EWS_HEADER_PRAGMA] = "Pragma",
+    [EWS_HEADER_PRIORITY] = "Priority",
+    [EWS_HEADER_RANGE] = "Range",
+    [EWS_HEADER_REFERER] = "Referer",
+    [EWS_HEADER_SEC_FETCH_DEST] = "Sec-Fetch-Dest",
+    [EWS_HEADER_SEC_FETCH_MODE] = "Sec-Fetch-Mode",
+    [EWS_HEADER_SEC_FETCH_SITE] = "Sec-Fetch-Site",
+    [EWS_HEADER_SEC_FETCH_USER] = "Sec-Fetch-User",
+    [EWS_HEADER_SEC_WEBSOCKET_EXTENSIONS] = "Sec-WebSocket-Extensions",
+    [EWS_HEADER_SEC_WEBSOCKET_KEY] = "Sec-WebSocket-Key",
+    [EWS_HEADER_SEC_WEBSOCKET_PROTOCOL] = "Sec-WebSocket-Protocol",
+    [EWS_HEADER_SEC_WEBSOCKET_VERSION] = "Sec-WebSocket-Version",
+    [EWS_HEADER_TE] = "TE",
+    [EWS_HEADER_TRAILER] = "Trailer",
+    [EWS_HEADER_TRANSFER_ENCODING] = "Transfer-Encoding",
+    [EWS_HEADER_UPGRADE] = "Upgrade",
+    [EWS_HEADER_UPGRADE_INSECURE_REQUESTS] = "Upgrade-Insecure-Requests",
+    [EWS_HEADER_USER_AGENT] = "User-Agent",
+    [EWS_HEADER_VIA] = "Via",
+    [EWS_HEADER_X_FORWARDED_FOR] = "X-Forwarded-For",
+    [EWS_HEADER_X_FORWARDED_HOST] = "X-Forwarded-Host",
+    [EWS_HEADER_X_FORWARDED_PROTO] = "X-Forwarded-Proto",
+    [EWS_HEADER_X_REQUESTED_WITH] = "X-Requested-With",
+};
+
+static const uint8_t header_lengths[EWS_HEADER_COUNT] = {
+    [EWS_HEADER_ACCEPT] = 6,
+    [EWS_HEADER_ACCEPT_CHARSET] = 14,
+    [EWS_HEADER_ACCEPT_ENCODING] = 15,
+    [EWS_HEADER_ACCEPT_LANGUAGE] = 15,
+    [EWS_HEADER_ACCESS_CONTROL_REQUEST_HEADERS] = 30,
+    [EWS_HEADER_ACCESS_CONTROL_REQUEST_METHOD] = 29,
+    [EWS_HEADER_AUTHORIZATION] = 13,
+    [EWS_HEADER_CACHE_CONTROL] = 13,
+    [EWS_HEADER_CONNECTION] = 10,
+    [EWS_HEADER_CONTENT_DISPOSITION] = 19,
+    [EWS_HEADER_CONTENT_ENCODING] = 16,
+    [EWS_HEADER_CONTENT_LENGTH] = 14,
+    [EWS_HEADER_CONTENT_TYPE] = 12,
+    [EWS_HEADER_COOKIE] = 6,
+    [EWS_HEADER_DNT] = 3,
+    [EWS_HEADER_DATE] = 4,
+    [EWS_HEADER_EXPECT] = 6,
+    [EWS_HEADER_FORWARDED] = 9,
+    [EWS_HEADER_HOST] = 4,
+    [EWS_HEADER_IF_MATCH] = 8,
+    [EWS_HEADER_IF_MODIFIED_SINCE] = 17,
+    [EWS_HEADER_IF_NONE_MATCH] = 13,
+    [EWS_HEADER_IF_RANGE] = 8,
+    [EWS_HEADER_IF_UNMODIFIED_SINCE] = 19,
+    [EWS_HEADER_KEEP_ALIVE] = 10,
+    [EWS_HEADER_ORIGIN] = 6,
+    [EWS_HEADER_PRAGMA] = 6,
+    [EWS_HEADER_PRIORITY] = 8,
+    [EWS_HEADER_RANGE] = 5,
+    [EWS_HEADER_REFERER] = 7,
+    [EWS_HEADER_SEC_FETCH_DEST] = 14,
+    [EWS_HEADER_SEC_FETCH_MODE] = 14,
+    [EWS_HEADER_SEC_FETCH_SITE] = 14,
+    [EWS_HEADER_SEC_FETCH_USER] = 14,
+    [EWS_HEADER_SEC_WEBSOCKET_EXTENSIONS] = 24,
+    [EWS_HEADER_SEC_WEBSOCKET_KEY] = 17,
+    [EWS_HEADER_SEC_WEBSOCKET_PROTOCOL] = 22,
+    [EWS_HEADER_SEC_WEBSOCKET_VERSION] = 21,
+    [EWS_HEADER_TE] = 2,
+    [EWS_HEADER_TRAILER] = 7,
+    [EWS_HEADER_TRANSFER_ENCODING] = 17,
+    [EWS_HEADER_UPGRADE] = 7,
+    [EWS_HEADER_UPGRADE_INSECURE_REQUESTS] = 25,
+    [EWS_HEADER_USER_AGENT] = 10,
+    [EWS_HEADER_VIA] = 3,
+    [EWS_HEADER_X_FORWARDED_FOR] = 15,
+    [EWS_HEADER_X_FORWARDED_HOST] = 16,
+    [EWS_HEADER_X_FORWARDED_PROTO] = 17,
+    [EWS_HEADER_X_REQUESTED_WITH] = 16,
+};
+
+static const uint8_t header_slots[1 << HEADER_BITS] = {
+     0,  0,  0,  0, 49, 38,  0,  0,
+    18,  0,  0,  0,  0, 43,  0,  0,
+     0, 31, 32, 23,  0,  0,  0, 25,
+    16,  0,  0,  0,  0, 10,  0, 34,
+    17,  0, 37, 46,  0,  0, 33,  1,
+     5,  9,  8,  0, 30,  0,  0,  0,
+     0,  0,  0,  0,  0,  4, 24,  0,
+    19, 44, 27, 21,  0,  0, 12, 41,
+     0,  0, 13,  0,  0, 11,  0,  0,
+    47,  2,  0, 42,  0,  0,  0,  0,
+    36,  0, 45,  0,  7,  0,  0,  0,
+     0, 22, 39, 20,  0,  0,  0, 29,
+     0,  0,  6,  0,  0, 40,  0,  0,
+     0,  0,  0,  0,  3,  0, 14,  0,
+    28,  0, 26,  0, 48, 35, 15,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+/// up to eight bytes as a little endian word with 0x20 or'ed into every
+/// byte; that lowercases letters, and the only token characters it changes
+/// otherwise, '^' and '_', appear in no well-known name
+static inline uint64_t header_fold(const char *p, size_t len)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, p, len);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word | (0x2020202020202020ull >> (64 - 8 * len));
+}
+
+ews_header_id_t ews_header_lookup(const char *name, size_t len)
+{
+    uint64_t h = len;
+    const char *known;
+    uint8_t id;
+
+    if (len == 0 || len > UINT8_MAX) {
+        return EWS_HEADER_UNKNOWN;
+    }
+
+    for (size_t i = 0; i < len; i += 8) {
+        size_t n = len - i < 8 ? len - i : 8;
+        h = (h ^ header_fold(&name[i], n)) * HEADER_MIX;
+    }
+
+    id = header_slots[(h * HEADER_SEED) >> (64 - HEADER_BITS)];
+    if (id == EWS_HEADER_UNKNOWN || header_lengths[id] != len) {
+        return EWS_HEADER_UNKNOWN;
+    }
+
+    /// folding both sides is exact for tokens against the known names
+    known = header_names[id];
+    for (size_t i = 0; i < len; i += 8) {
+        size_t n = len - i < 8 ? len - i : 8;
+        if (header_fold(&name[i], n) != header_fold(&known[i], n)) {
+            return EWS_HEADER_UNKNOWN;
+        }
+    }
+    return id;
+}
+
+const char *ews_header_name(ews_header_id_t id)
+{
+    if (id >= EWS_HEADER_COUNT) {
+        return NULL;
+    }
+    return header_names[id];
+}
@@ -1,36 +1,469 @@
 // SPDX-License-Identifier: MIT
-#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/types.h>
 
 #include "http.h"
 #include "ews.h"
 #include "route.h"
+#include "scan.h"
 #include "server.h"
 #include "socket.h"
 #include "utils.h"
 
 
+/// up to eight bytes of a string literal as a little endian word
+#define HTTP_WORD(s) ( \
+        (sizeof(s) > 1 ? (uint64_t) (uint8_t) (s)[0] <<  0 : 0) | \
+        (sizeof(s) > 2 ? (uint64_t) (uint8_t) (s)[1] <<  8 : 0) | \
+        (sizeof(s) > 3 ? (uint64_t) (uint8_t) (s)[2] << 16 : 0) | \
+        (sizeof(s) > 4 ? (uint64_t) (uint8_t) (s)[3] << 24 : 0) | \
+        (sizeof(s) > 5 ? (uint64_t) (uint8_t) (s)[4] << 32 : 0) | \
+        (sizeof(s) > 6 ? (uint64_t) (uint8_t) (s)[5] << 40 : 0) | \
+        (sizeof(s) > 7 ? (uint64_t) (uint8_t) (s)[6] << 48 : 0) | \
+        (sizeof(s) > 8 ? (uint64_t) (uint8_t) (s)[7] << 56 : 0))
+
+/// clears the lowercase bit of letters; methods consist of letters only, so
+/// no other byte can turn into one of them
+#define HTTP_WORD_UPPER 0xdfdfdfdfdfdfdfdfull
+/// same for the letters of "HTTP/x.x"
+#define HTTP_VERSION_UPPER 0xffffffffdfdfdfdfull
+
+static const struct {
+    uint64_t word;
+    uint8_t len;
+    uint8_t id;
+} http_methods[] = {
+    {HTTP_WORD("GET"),      3, EWS_SESS_METHOD_GET},
+    {HTTP_WORD("POST"),     4, EWS_SESS_METHOD_POST},
+    {HTTP_WORD("OPTIONS"),  7, EWS_SESS_METHOD_OPTIONS},
+    {HTTP_WORD("HEAD"),     4, EWS_SESS_METHOD_HEAD},
+#if CONFIG_EWS_RARE_METHODS
+    {HTTP_WORD("CONNECT"),  7, EWS_SESS_METHOD_CONNECT},
+    {HTTP_WORD("DELETE"),   6, EWS_SESS_METHOD_DELETE},
+    {HTTP_WORD("PATCH"),    5, EWS_SESS_METHOD_PATCH},
+    {HTTP_WORD("PUT"),      3, EWS_SESS_METHOD_PUT},
+    {HTTP_WORD("TRACE"),    5, EWS_SESS_METHOD_TRACE},
+#endif
+};
+
+/// status lines staged without formatting
+#define HTTP_STATUS_LINES(X) \
+    X(100, "Continue") \
+    X(101, "Switching Protocols") \
+    X(200, "OK") \
+    X(201, "Created") \
+    X(202, "Accepted") \
+    X(204, "No Content") \
+    X(206, "Partial Content") \
+    X(301, "Moved Permanently") \
+    X(302, "Found") \
+    X(303, "See Other") \
+    X(304, "Not Modified") \
+    X(307, "Temporary Redirect") \
+    X(308, "Permanent Redirect") \
+    X(400, "Bad Request") \
+    X(401, "Unauthorized") \
+    X(403, "Forbidden") \
+    X(404, "Not Found") \
+    X(405, "Method Not Allowed") \
+    X(408, "Request Timeout") \
+    X(411, "Length Required") \
+    X(413, "Content Too Large") \
+    X(414, "URI Too Long") \
+    X(415, "Unsupported Media Type") \
+    X(416, "Range Not Satisfiable") \
+    X(417, "Expectation Failed") \
+    X(425, "Too Early") \
+    X(429, "Too Many Requests") \
+    X(431, "Request Header Fields Too Large") \
+    X(500, "Internal Server Error") \
+    X(501, "Not Implemented") \
+    X(503, "Service Unavailable") \
+    X(505, "HTTP Version Not Supported")
+
+/// complete error responses, the length is that of "<h1>msg</h1>"
+#define HTTP_ERRORS(X) \
+    X(400, "Bad Request", 20) \
+    X(401, "Unauthorized", 21) \
+    X(403, "Forbidden", 18) \
+    X(404, "Not Found", 18) \
+    X(405, "Method Not Allowed", 27) \
+    X(408, "Request Timeout", 24) \
+    X(411, "Length Required", 24) \
+    X(413, "Content Too Large", 26) \
+    X(414, "URI Too Long", 21) \
+    X(417, "Expectation Failed", 27) \
+    X(425, "Too Early", 18) \
+    X(431, "Request Header Fields Too Large", 40) \
+    X(500, "Internal Server Error", 30) \
+    X(501, "Not Implemented", 24) \
+    X(503, "Service Unavailable", 28) \
+    X(505, "HTTP Version Not Supported", 35)
+
+#define HTTP_STATUS_LINE(code, msg) \
+    {code, sizeof(msg) - 1, msg, #code " " msg "\r\n", \
+            sizeof(#code " " msg "\r\n") - 1},
+
+#define HTTP_ERROR(code, msg, len) \
+    {code, sizeof(msg) - 1, msg, sizeof(#code " " msg "\r\n") - 1, \
+            #code " " msg "\r\n" \
+            "Content-Type: text/html\r\nContent-Length: " #len "\r\n\r\n" \
+            "<h1>" msg "</h1>", sizeof(#code " " msg "\r\n" \
+            "Content-Type: text/html\r\nContent-Length: " #len "\r\n\r\n" \
+            "<h1>" msg "</h1>") - 1},
+
+#define HTTP_ERROR_CHECK(code, msg, len) \
+    _Static_assert(sizeof("<h1>" msg "</h1>") - 1 == len, \
+            "wrong content length of error " #code);
+
+HTTP_ERRORS(HTTP_ERROR_CHECK)
+
+/// largest chunk size line, 16 hex digits and CRLF
+#define HTTP_CHUNK_LINE 18
+
+/// "Date: " and an IMF-fixdate with CRLF
+#define HTTP_DATE_LINE (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+/// everything after "HTTP/1.x "
+static const struct {
+    uint16_t code;
+    uint8_t msg_len;
+    const char *msg;
+    const char *line;
+    uint8_t line_len;
+} http_status_lines[] = {
+    HTTP_STATUS_LINES(HTTP_STATUS_LINE)
+};
+
+/// everything after "HTTP/1.x "
+static const struct {
+    uint16_t code;
+    uint8_t msg_len;
+    const char *msg;
+    /// the status line, the standard headers go after it
+    uint8_t line_len;
+    const char *text;
+    uint16_t text_len;
+} http_errors[] = {
+    HTTP_ERRORS(HTTP_ERROR)
+};
+
+_Static_assert(CONFIG_EWS_SESSION_BUFSIZE_MAX <= UINT16_MAX + 1,
+        "header offsets do not fit the session buffer");
+
 static void finalize(ews_sess_t *sess);
 static void http_error(ews_sess_t *sess, int code, const char *msg);
 
+/// load up to eight bytes as a little endian word, zero padded
+static inline uint64_t http_word(const uint8_t *buf, size_t len)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, buf, MIN(len, sizeof(word)));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/// decimal digits of v, returns their number
+static size_t http_utoa(char *p, uint64_t v)
+{
+    char tmp[20];
+    size_t n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+
+    for (size_t i = 0; i < n; i++) {
+        p[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+/// upper case hex digits of v without leading zeros, returns their number
+static size_t http_xtoa(char *p, uint64_t v)
+{
+    static const char digits[] = "0123456789ABCDEF";
+    size_t n = v ? (64 - __builtin_clzll(v) + 3) / 4 : 1;
+
+    for (size_t i = n; i > 0; i--) {
+        p[i - 1] = digits[v & 0xf];
+        v >>= 4;
+    }
+    return n;
+}
+
+static uint8_t http_method(const uint8_t *buf, size_t len)
+{
+    uint64_t word;
+
+    if (len > sizeof(word)) {
+        return EWS_SESS_METHOD_OTHER;
+    }
+
+    word = http_word(buf, len) & HTTP_WORD_UPPER;
+    for (size_t i = 0; i < countof(http_methods); i++) {
+        if (http_methods[i].word == word && http_methods[i].len == len) {
+            return http_methods[i].id;
+        }
+    }
+    return EWS_SESS_METHOD_OTHER;
+}
+
+/// take a first tier buffer for a connection that starts reading
+static bool http_buf_get(ews_http_data_t *data)
+{
+    ews_bufpool_t *pool = &data->sess.sock->ews->bufpool;
+
+    data->buf = ews_bufpool_get(pool, 0);
+    if (data->buf == NULL) {
+        return false;
+    }
+    data->bufsize = ews_bufpool_size(0);
+    data->buftier = 0;
+    return true;
+}
+
+/// move the buffered bytes to a buffer of the next tier, for a request line
+/// or header block that does not fit
+static bool http_buf_grow(ews_http_data_t *data)
+{
+    ews_bufpool_t *pool = &data->sess.sock->ews->bufpool;
+    size_t size = ews_bufpool_size(data->buftier + 1);
+    uint8_t *buf;
+
+    if (size == 0) {
+        return false;
+    }
+    buf = ews_bufpool_get(pool, data->buftier + 1);
+    if (buf == NULL) {
+        return false;
+    }
+
+    memcpy(buf, data->buf, data->bufpos + data->buflen);
+    ews_bufpool_put(pool, data->buf, data->buftier);
+    data->buf = buf;
+    data->bufsize = size;
+    data->buftier++;
+
+    LOGV("#%d session buffer grown to %zu", data->sess.sock->fd, size);
+    return true;
+}
+
+/// give the buffer back to the pool, idle connections hold none
+static void http_buf_put(ews_http_data_t *data)
+{
+    ews_bufpool_t *pool = &data->sess.sock->ews->bufpool;
+
+    ews_bufpool_put(pool, data->buf, data->buftier);
+    data->buf = NULL;
+    data->bufsize = 0;
+    data->bufpos = 0;
+    data->buflen = 0;
+    data->head = 0;
+    data->head_len = 0;
+    data->early_end = 0;
+    data->scanned = 0;
+}
+
+/// find the end of the line at bufpos; the search resumes where the last
+/// one stopped, so a line trickling in is scanned only once
+static ssize_t http_line(ews_http_data_t *data)
+{
+    ssize_t ret;
+
+    ret = ews_scan_crlf(&data->buf[data->bufpos + data->scanned],
+            data->buflen - data->scanned);
+    if (ret < 0) {
+        /// a trailing '\r' may still turn into a CRLF
+        data->scanned = data->buflen > 0 ? data->buflen - 1 : 0;
+        return -1;
+    }
+    ret += data->scanned;
+    data->scanned = 0;
+    return ret;
+}
+
+const char *ews_sess_get_header(ews_sess_t *sess, const char *name)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    const uint8_t *head = &data->buf[data->head];
+    size_t len = strlen(name);
+    uint8_t id = ews_header_lookup(name, len);
+
+    for (size_t i = 0; i < data->block.header_count; i++) {
+        const ews_http_header_t *header = &data->block.headers[i];
+        if (header->id != id) {
+            continue;
+        }
+        /// well-known names are equal by id
+        if (id != EWS_HEADER_UNKNOWN || (header->name_len == len &&
+                strncasecmp((char *) &head[header->name], name, len) == 0)) {
+            return (char *) &head[header->value];
+        }
+    }
+    return NULL;
+}
+
+const char *ews_sess_get_trailer(ews_sess_t *sess, const char *name)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+
+    for (const ews_http_trailer_t *trailer = data->block.trailers; trailer;
+            trailer = trailer->next) {
+        if (strcasecmp(trailer->name, name) == 0) {
+            return trailer->value;
+        }
+    }
+    return NULL;
+}
+
 static ssize_t http_recv(ews_sess_t *sess, void *buf, size_t len)
 {
     len = MIN(len, sess->data.chunk_len);
     if (buf) {
         memcpy(buf, sess->data.chunk, len);
     }
+    sess->data.chunk += len;
     sess->data.chunk_len -= len;
     return len;
 }
 
+static void http_out_release(ews_http_data_t *data)
+{
+    ews_bufpool_put(&data->sess.sock->ews->bufpool, data->out,
+            data->out_tier);
+    data->out = NULL;
+    data->out_size = 0;
+    data->out_pos = 0;
+    data->out_len = 0;
+}
+
+/// room for len more bytes behind the staged output; it never flushes, so
+/// callers may still patch what they staged
+static uint8_t *http_out_reserve(ews_http_data_t *data, size_t len)
+{
+    ews_bufpool_t *pool = &data->sess.sock->ews->bufpool;
+    unsigned int tier;
+    size_t size;
+    uint8_t *out;
+
+    if (data->out) {
+        if (data->out_pos + data->out_len + len <= data->out_size) {
+            return &data->out[data->out_pos + data->out_len];
+        }
+        if (data->out_len + len <= data->out_size) {
+            memmove(data->out, &data->out[data->out_pos], data->out_len);
+            data->out_pos = 0;
+            return &data->out[data->out_len];
+        }
+    }
+
+    /// the smallest tier that fits
+    tier = data->out ? data->out_tier + 1 : 0;
+    while ((size = ews_bufpool_size(tier)) > 0 && size < data->out_len + len) {
+        tier++;
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    out = ews_bufpool_get(pool, tier);
+    if (out == NULL) {
+        return NULL;
+    }
+
+    if (data->out) {
+        memcpy(out, &data->out[data->out_pos], data->out_len);
+        ews_bufpool_put(pool, data->out, data->out_tier);
+    }
+    data->out = out;
+    data->out_size = size;
+    data->out_tier = tier;
+    data->out_pos = 0;
+    return &out[data->out_len];
+}
+
+static bool http_out_write(ews_http_data_t *data, const void *buf, size_t len)
+{
+    uint8_t *p = http_out_reserve(data, len);
+
+    if (p == NULL) {
+        return false;
+    }
+    memcpy(p, buf, len);
+    data->out_len += len;
+    return true;
+}
+
+/// format behind the staged output, a second pass only if it does not fit
+static ssize_t http_out_vprintf(ews_http_data_t *data, const char *fmt,
+        va_list va)
+{
+    size_t space = 0;
+    uint8_t *p = NULL;
+    va_list va2;
+    int ret;
+
+    if (data->out) {
+        p = &data->out[data->out_pos + data->out_len];
+        space = data->out_size - data->out_pos - data->out_len;
+    }
+
+    va_copy(va2, va);
+    ret = vsnprintf((char *) p, space, fmt, va);
+    if (ret >= 0 && (size_t) ret >= space) {
+        p = http_out_reserve(data, ret + 1);
+        ret = p ? vsnprintf((char *) p, ret + 1, fmt, va2) : -1;
+    }
+    va_end(va2);
+
+    if (ret > 0) {
+        data->out_len += ret;
+    }
+    return ret;
+}
+
+/// hand the staged output to the socket
+/// @return @b false if some is left, it goes out once the socket is writable
+static bool http_out_flush(ews_http_data_t *data)
+{
+    ews_sock_t *sock = data->sess.sock;
+    ssize_t ret;
+
+    while (data->out_len > 0) {
+        ret = sock->ops->send(sock, &data->out[data->out_pos], data->out_len);
+        if (ret <= 0) {
+            return false;
+        }
+        data->out_pos += ret;
+        data->out_len -= ret;
+    }
+
+    if (data->out) {
+        http_out_release(data);
+    }
+    return true;
+}
+
+static void http_flush(ews_http_data_t *data)
+{
+    ews_sock_t *sock = data->sess.sock;
+
+    http_out_flush(data);
+    sock->ops->flush(sock);
+}
+
 static ssize_t http_send(ews_sess_t *sess, const void *buf, size_t len)
 {
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
     ews_sock_t *sock = sess->sock;
-    ssize_t ret = 0;
-    size_t total = 0;
+    ssize_t ret;
+    uint8_t *p;
 
     if (data->block.state != EWS_SESS_RESPONSE_BODY) {
         LOGD("attempted to send data in non-response-data state");
@@ -38,97 +471,230 @@ static ssize_t http_send(ews_sess_t *sess, const void *buf, size_t len)
         return -1;
     }
 
-    if (data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED) {
-        char s[11];
-        ret = snprintf(s, sizeof(s), "%lX\r\n", len);
-        ret = sock->ops->send(sock, s, ret);
-        if (ret < 0) {
-            finalize(sess);
-            return -1;
-        }
-        total += ret;
-    } else if (data->block.response.length > 0) {
+    if (!(data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED) &&
+            data->block.response.length > 0) {
         len = MIN(len, data->block.response.length);
     }
+    /// an empty chunk would end the body
+    if (len == 0) {
+        return 0;
+    }
 
-    ret = sock->ops->send(sock, buf, len);
-    if (ret < 0) {
-        finalize(sess);
-        return -1;
+    /// keep the staged output bounded
+    if (data->out_len >= CONFIG_EWS_SEND_LOWAT) {
+        http_out_flush(data);
     }
-    total += ret;
 
     if (data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED) {
-        ret = sock->ops->send(sock, "\r\n", 2);
+        size_t n;
+
+        /// chunks are staged whole, a short write cannot break the framing
+        p = http_out_reserve(data, len + HTTP_CHUNK_LINE + 2);
+        if (p == NULL) {
+            len = MIN(len, ews_bufpool_size(0) / 2);
+            p = http_out_reserve(data, len + HTTP_CHUNK_LINE + 2);
+            if (p == NULL) {
+                return 0;
+            }
+        }
+
+        n = http_xtoa((char *) p, len);
+        p[n++] = '\r';
+        p[n++] = '\n';
+        memcpy(&p[n], buf, len);
+        n += len;
+        p[n++] = '\r';
+        p[n++] = '\n';
+        data->out_len += n;
+        return len;
+    }
+
+    /// larger bodies skip the copy once nothing is staged ahead of them
+    if (len >= ews_bufpool_size(0) && http_out_flush(data)) {
+        ret = sock->ops->send(sock, buf, len);
         if (ret < 0) {
-            finalize(sess);
-            return -1;
+            if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
+                finalize(sess);
+                return -1;
+            }
+            return 0;
+        }
+    } else {
+        if (!http_out_write(data, buf, len)) {
+            return 0;
         }
-        total += ret;
-    } else if (data->block.response.length > 0) {
+        ret = len;
+    }
+
+    if (data->block.response.length > 0) {
         data->block.response.length -= ret;
     }
 
-    return total;
+    return ret;
 }
 
-static void http_vsendf(ews_sess_t *sess, const char *fmt, va_list va)
+static ssize_t http_sendfile(ews_sess_t *sess, int fd, off_t *offset,
+        size_t len)
 {
-    va_list va2;
-    size_t len;
-    char *buf;
-
-    va_copy(va2, va);
-    len = vsnprintf(NULL, 0, fmt, va);
-    buf = alloca(len);
-    vsprintf(buf, fmt, va2);
-    http_send(sess, buf, len);
-}
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ews_sock_t *sock = sess->sock;
+    ssize_t ret;
 
-static void http_sendf(ews_sess_t *sess, const char *fmt, ...)
-{
-    va_list va;
+    if (data->block.state != EWS_SESS_RESPONSE_BODY ||
+            (data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED)) {
+        LOGD("attempted to send file in non-response-data state or chunked");
+        http_error(sess, 500, "Internal Server Error");
+        return -1;
+    }
 
-    va_start(va, fmt);
-    http_vsendf(sess, fmt, va);
-    va_end(va);
-}
+    if (data->block.response.length > 0) {
+        len = MIN(len, data->block.response.length);
+    }
 
-static ssize_t http_raw_send(ews_sess_t *sess, const void *buf, size_t len)
-{
-    ews_sock_t *sock = sess->sock;
-    ssize_t ret;
+    /// the response head has to go first
+    if (!http_out_flush(data)) {
+        return 0;
+    }
 
-    ret = sock->ops->send(sock, buf, len);
+    ret = sock->ops->sendfile(sock, fd, offset, len);
     if (ret < 0) {
         finalize(sess);
         return -1;
     }
+
+    if (data->block.response.length > 0) {
+        data->block.response.length -= ret;
+    }
+
     return ret;
 }
 
-static void http_raw_vsendf(ews_sess_t *sess, const char *fmt, va_list va)
+static void *http_alloc(ews_sess_t *sess, size_t size)
 {
-    va_list va2;
-    size_t len;
-    char *buf;
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
 
-    va_copy(va2, va);
-    len = vsnprintf(NULL, 0, fmt, va);
-    buf = alloca(len);
-    vsprintf(buf, fmt, va2);
-    http_raw_send(sess, buf, len);
+    return ews_arena_alloc(&data->arena, &sess->sock->ews->bufpool, size);
+}
+
+static void http_vsendf(ews_sess_t *sess, const char *fmt, va_list va)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    size_t mark = data->out_len;
+    ssize_t ret;
+    uint8_t *p;
+    size_t n;
+
+    if (data->block.state != EWS_SESS_RESPONSE_BODY) {
+        LOGD("attempted to send data in non-response-data state");
+        http_error(sess, 500, "Internal Server Error");
+        return;
+    }
+
+    if (data->out_len >= CONFIG_EWS_SEND_LOWAT) {
+        http_out_flush(data);
+        mark = data->out_len;
+    }
+
+    if (!(data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED)) {
+        ret = http_out_vprintf(data, fmt, va);
+        if (ret < 0) {
+            goto fail;
+        }
+        if (data->block.response.length > 0) {
+            if ((size_t) ret > data->block.response.length) {
+                data->out_len -= ret - data->block.response.length;
+                ret = data->block.response.length;
+            }
+            data->block.response.length -= ret;
+        }
+        return;
+    }
+
+    /// leave room for the chunk size line, the data moves up to its actual
+    /// length afterwards
+    if (http_out_reserve(data, HTTP_CHUNK_LINE) == NULL) {
+        goto fail;
+    }
+    data->out_len += HTTP_CHUNK_LINE;
+    ret = http_out_vprintf(data, fmt, va);
+    if (ret < 0 || http_out_reserve(data, 2) == NULL) {
+        goto fail;
+    }
+    if (ret == 0) {
+        data->out_len = mark;
+        return;
+    }
+
+    p = &data->out[data->out_pos + mark];
+    n = http_xtoa((char *) p, ret);
+    p[n++] = '\r';
+    p[n++] = '\n';
+    memmove(&p[n], &p[HTTP_CHUNK_LINE], ret);
+    n += ret;
+    p[n++] = '\r';
+    p[n++] = '\n';
+    data->out_len = mark + n;
+    return;
+
+fail:
+    data->out_len = mark;
+    http_error(sess, 500, "Internal Server Error");
 }
 
-static void http_raw_sendf(ews_sess_t *sess, const char *fmt, ...)
+static void http_sendf(ews_sess_t *sess, const char *fmt, ...)
 {
     va_list va;
 
     va_start(va, fmt);
-    http_raw_vsendf(sess, fmt, va);
+    http_vsendf(sess, fmt, va);
     va_end(va);
 }
 
+/// stage a status line, precomputed for the common codes, and the standard
+/// headers
+static bool http_out_status(ews_http_data_t *data, int code, const char *msg)
+{
+    const ews_http_std_t *std = &data->sess.sock->ews->http_std;
+    const char *version = data->block.version == EWS_HTTP_VERSION_11 ?
+            "HTTP/1.1 " : "HTTP/1.0 ";
+    size_t len = strlen(msg);
+    uint8_t *p;
+    size_t n;
+
+    for (size_t i = 0; i < countof(http_status_lines); i++) {
+        if (http_status_lines[i].code == code &&
+                http_status_lines[i].msg_len == len &&
+                memcmp(http_status_lines[i].msg, msg, len) == 0) {
+            n = 9 + http_status_lines[i].line_len;
+            p = http_out_reserve(data, n + std->len);
+            if (p == NULL) {
+                return false;
+            }
+            memcpy(p, version, 9);
+            memcpy(&p[9], http_status_lines[i].line,
+                    http_status_lines[i].line_len);
+            goto std;
+        }
+    }
+
+    p = http_out_reserve(data, 9 + 20 + 1 + len + 2 + std->len);
+    if (p == NULL) {
+        return false;
+    }
+    memcpy(p, version, 9);
+    n = 9 + http_utoa((char *) &p[9], code);
+    p[n++] = ' ';
+    memcpy(&p[n], msg, len);
+    n += len;
+    p[n++] = '\r';
+    p[n++] = '\n';
+
+std:
+    memcpy(&p[n], std->buf, std->len);
+    data->out_len += n + std->len;
+    return true;
+}
+
 static void http_status(ews_sess_t *sess, int code, const char *msg)
 {
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
@@ -143,27 +709,78 @@ static void http_status(ews_sess_t *sess, int code, const char *msg)
         return;
     }
 
-    http_raw_sendf(sess, "%s %d %s\r\n",
-            data->block.version == EWS_HTTP_VERSION_11 ? "HTTP/1.1" :
-            "HTTP/1.0", code, msg);
+    if (!http_out_status(data, code, msg)) {
+        sess->sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        finalize(sess);
+    }
+}
+
+/// stage a complete error response, prebuilt for the common errors
+static bool http_out_error(ews_http_data_t *data, int code, const char *msg)
+{
+    const ews_http_std_t *std = &data->sess.sock->ews->http_std;
+    static const char head[] =
+            "Content-Type: text/html\r\nContent-Length: ";
+    const char *version = data->block.version == EWS_HTTP_VERSION_11 ?
+            "HTTP/1.1 " : "HTTP/1.0 ";
+    size_t len = strlen(msg);
+    uint8_t *p;
+    size_t n;
+
+    for (size_t i = 0; i < countof(http_errors); i++) {
+        if (http_errors[i].code == code && http_errors[i].msg_len == len &&
+                memcmp(http_errors[i].msg, msg, len) == 0) {
+            n = http_errors[i].line_len;
+            p = http_out_reserve(data, 9 + http_errors[i].text_len + std->len);
+            if (p == NULL) {
+                return false;
+            }
+            memcpy(p, version, 9);
+            p += 9;
+            memcpy(p, http_errors[i].text, n);
+            memcpy(&p[n], std->buf, std->len);
+            memcpy(&p[n + std->len], &http_errors[i].text[n],
+                    http_errors[i].text_len - n);
+            data->out_len += 9 + http_errors[i].text_len + std->len;
+            return true;
+        }
+    }
+
+    if (!http_out_status(data, code, msg)) {
+        return false;
+    }
+    p = http_out_reserve(data, sizeof(head) - 1 + 20 + 4 + 4 + len + 5);
+    if (p == NULL) {
+        return false;
+    }
+    memcpy(p, head, sizeof(head) - 1);
+    n = sizeof(head) - 1;
+    n += http_utoa((char *) &p[n], len + 9);
+    memcpy(&p[n], "\r\n\r\n<h1>", 8);
+    n += 8;
+    memcpy(&p[n], msg, len);
+    n += len;
+    memcpy(&p[n], "</h1>", 5);
+    n += 5;
+    data->out_len += n;
+    return true;
 }
 
 static void http_error(ews_sess_t *sess, int code, const char *msg)
 {
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
-    const char *fmt1, *fmt2;
-    size_t len;
+
+    /// the rest of the request is not read, it would be taken for the next
+    if (data->block.state == EWS_SESS_REQUEST_HEADER ||
+            data->block.state == EWS_SESS_REQUEST_BODY) {
+        data->block.flags &= ~EWS_HTTP_FLAGS_KEEPALIVE;
+    }
 
     if (data->block.state <= EWS_SESS_RESPONSE_BEGIN &&
             data->block.version > EWS_HTTP_VERSION_09) {
-
-        fmt1 = "Content-Type: text/html\r\nContent-Length: %lu\r\n\r\n";
-        fmt2 = "<h1>%s</h1>";
-        len = snprintf(NULL, 0, fmt2, msg);
-
-        http_status(sess, code, msg);
-        http_raw_sendf(sess, fmt1, len);
-        http_raw_sendf(sess, fmt2, msg);
+        http_out_error(data, code, msg);
+        /// errors in request begin are followed by a close, not a finalize
+        http_flush(data);
     }
 
     finalize(sess);
@@ -172,6 +789,9 @@ static void http_error(ews_sess_t *sess, int code, const char *msg)
 static void http_header(ews_sess_t *sess, const char *name, const char *value)
 {
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    uint8_t *p;
 
     if (data->block.state != EWS_SESS_RESPONSE_HEADER) {
         LOGD("attempted to send headers in non-response header state");
@@ -179,21 +799,106 @@ static void http_header(ews_sess_t *sess, const char *name, const char *value)
         return;
     }
 
-    if (strcasecmp(name, "Connection") == 0) {
+    switch (ews_header_lookup(name, name_len)) {
+    case EWS_HEADER_CONNECTION:
         if (strstr(value, "close")) {
             data->block.flags &= ~EWS_HTTP_FLAGS_KEEPALIVE;
         } else if (strstr(value, "keep-alive")) {
             data->block.flags |= EWS_HTTP_FLAGS_KEEPALIVE;
         }
-    } else if (strcasecmp(name, "Content-Length") == 0) {
+        break;
+
+    case EWS_HEADER_CONTENT_LENGTH:
         data->block.response.length = strtol(value, NULL, 10);
-    } else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+        break;
+
+    case EWS_HEADER_TRANSFER_ENCODING:
         if (strstr(value, "chunked")) {
             data->block.flags |= EWS_HTTP_FLAGS_RESPONSE_CHUNKED;
         }
+        break;
+
+    /// already sent with the status line
+    case EWS_HEADER_DATE:
+        return;
+
+    default:
+        if (name_len == 6 && strncasecmp(name, "Server", 6) == 0 &&
+                sess->sock->ews->http_std.server) {
+            return;
+        }
+        break;
+    }
+
+    p = http_out_reserve(data, name_len + 2 + value_len + 2);
+    if (p == NULL) {
+        sess->sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        finalize(sess);
+        return;
+    }
+    memcpy(p, name, name_len);
+    p += name_len;
+    *p++ = ':';
+    *p++ = ' ';
+    memcpy(p, value, value_len);
+    p += value_len;
+    *p++ = '\r';
+    *p++ = '\n';
+    data->out_len += name_len + 2 + value_len + 2;
+}
+
+static uint32_t http_pause(ews_sess_t *sess)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    uint32_t token;
+
+    if (data->block.state != EWS_SESS_REQUEST_BODY) {
+        LOGD("attempted to pause in non-request-body state");
+        return 0;
+    }
+
+    token = __atomic_load_n(&data->paused, __ATOMIC_ACQUIRE);
+    if (token != 0) {
+        return token;
+    }
+
+    if (++data->pause_seq == 0) {
+        data->pause_seq = 1;
+    }
+    token = data->pause_seq;
+    __atomic_store_n(&data->paused, token, __ATOMIC_RELEASE);
+    return token;
+}
+
+static void http_resume(ews_sess_t *sess, uint32_t token)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+
+    /// the request that paused may have finished and the session been
+    /// reused, only the pause the token was issued for is lifted
+    if (token == 0 || !__atomic_compare_exchange_n(&data->paused, &token, 0,
+            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    /// buffered body data has to be delivered even if no more arrives
+    __atomic_store_n(&data->resumed, true, __ATOMIC_RELEASE);
+    ews_worker_wake(&sess->sock->ews->worker);
+}
+
+static void http_produce(ews_sess_t *sess, ews_sess_producer_t producer,
+        void *arg)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+
+    if ((data->block.state & 0x30) != 0x10) {
+        LOGD("attempted to set producer in non-response state");
+        http_error(sess, 500, "Internal Server Error");
+        return;
     }
 
-    http_raw_sendf(sess, "%s: %s\r\n", name, value);
+    data->block.response.producer = producer;
+    data->block.response.producer_arg = arg;
 }
 
 static const ews_sess_ops_t http_sess_ops = {
@@ -203,6 +908,11 @@ static const ews_sess_ops_t http_sess_ops = {
     .status = http_status,
     .error = http_error,
     .header = http_header,
+    .pause = http_pause,
+    .resume = http_resume,
+    .produce = http_produce,
+    .sendfile = http_sendfile,
+    .alloc = http_alloc,
 };
 
 static ews_route_status_t call_handler(ews_sess_t *sess)
@@ -253,7 +963,11 @@ static ews_route_status_t call_handler(ews_sess_t *sess)
             break;
 
         case EWS_SESS_RESPONSE_HEADER:
-            http_raw_send(sess, "\r\n", 2);
+            if (!http_out_write(data, "\r\n", 2)) {
+                sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+                finalize(sess);
+                return EWS_ROUTE_STATUS_ERROR;
+            }
             data->block.state = EWS_SESS_RESPONSE_BODY;
             break;
 
@@ -285,58 +999,92 @@ static ews_route_status_t call_handler(ews_sess_t *sess)
     }
 }
 
-static void parse_path(ews_sess_data_t *data)
+/// drop a "." or ".." segment that ends at po together with the slash in
+/// front of it, ".." takes the segment before it along
+static uint8_t *path_dot_segment(uint8_t *path, uint8_t *seg, uint8_t *po)
 {
-    uint8_t *pi = (uint8_t *) data->path;
-    uint8_t *po = (uint8_t *) data->path;
+    if (seg == NULL) {
+        return po;
+    }
 
-    while (*pi) {
-        if (*pi == '%' && isxdigit(*(pi + 1)) && isxdigit(*(pi + 2))) {
-            pi++;
-            *po = (toupper(*pi) - (isdigit(*pi) ? '0' : 'A' - 10)) << 4;
-            pi++;
-            *po |= (toupper(*pi) - (isdigit(*pi) ? '0' : 'A' - 10));
-            pi++;
-            po++;
+    if (po - seg == 1 && seg[0] == '.') {
+        return seg - 1;
+    }
+
+    if (po - seg == 2 && seg[0] == '.' && seg[1] == '.') {
+        po = seg - 1;
+        while (po > path) {
+            if (*--po == '/') {
+                break;
+            }
+        }
+    }
+    return po;
+}
+
+static void parse_path(ews_sess_data_t *data, size_t len)
+{
+    uint8_t *path = (uint8_t *) data->path;
+    uint8_t *pi = path;
+    uint8_t *po = path;
+    uint8_t *pe = pi + len;
+    /// start of the segment being decoded, dot segments are resolved on the
+    /// decoded bytes so that escaped dots and slashes cannot climb out
+    uint8_t *seg = NULL;
+    uint8_t c;
+    size_t n;
+
+    data->query = NULL;
+    data->query_len = 0;
+
+    /// the path is NUL terminated, so looking ahead stops at pe
+    while (pi < pe) {
+        /// plain runs are moved as a whole
+        n = ews_scan_path(pi, pe - pi);
+        if (n > 0) {
+            if (po != pi) {
+                memmove(po, pi, n);
+            }
+            pi += n;
+            po += n;
+            continue;
+        }
+
+        if (*pi == '%' && ews_scan_hex(*(pi + 1)) >= 0 &&
+                ews_scan_hex(*(pi + 2)) >= 0) {
+            c = ews_scan_hex(*(pi + 1)) << 4 | ews_scan_hex(*(pi + 2));
+            pi += 3;
         } else if (*pi == '+') {
+            c = ' ';
             pi++;
-            *po++ = ' ';
-        } else if (*pi == '/') {
-            if (*(pi + 1) == '.') {
-                if (*(pi + 2) == '\0' || *(pi + 2) == '/') {
-                    pi += 2;
-                    continue;
-                } else if (*(pi + 2) == '.') {
-                    if ((*pi + 3) == '\0' || (*pi + 3) == '/') {
-                        pi += 3;
-                        while (data->path_len > 0) {
-                            po--;
-                            data->path_len--;
-                            if (*po == '/') {
-                                break;
-                            }
-                        }
-                        continue;
-                    }
-                }
-            } else if (data->path_len > 0 && *(po - 1) == '/') {
-                pi++;
-                continue;
-            }
-            *po++ = *pi++;
         } else if (*pi == '?') {
             pi++;
-            *po++ = '\0';
             data->query = (char *) pi;
-            return;
+            data->query_len = pe - pi;
+            break;
         } else {
-            *po++ = *pi++;
+            c = *pi++;
         }
-        data->path_len++;
+
+        if (c == '/') {
+            po = path_dot_segment(path, seg, po);
+            if (po > path && *(po - 1) == '/') {
+                continue;
+            }
+            *po++ = '/';
+            seg = po;
+            continue;
+        }
+        *po++ = c;
     }
-    if (data->query) {
-        data->query_len = strlen(data->query);
+    po = path_dot_segment(path, seg, po);
+
+    /// dot segments can climb all the way out
+    if (po == path) {
+        *po++ = '/';
     }
+    *po = '\0';
+    data->path_len = po - path;
 }
 
 static bool request_begin(ews_sess_t *sess)
@@ -344,16 +1092,22 @@ static bool request_begin(ews_sess_t *sess)
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
     ews_http_request_t *request = &data->block.request;
     ews_sock_t *sock = sess->sock;
-    char *p, *version = NULL;
+    char *p, *end, *path_end, *version = NULL;
+    size_t len;
 
     /// initialization
     request->length = SIZE_MAX;
+    data->head = data->bufpos;
+    data->head_len = 0;
+    sess->data.early_data = data->bufpos < data->early_end;
 
     request->buf = &data->buf[data->bufpos];
-    request->buflen = find(request->buf, data->buflen, "\r\n");
+    request->buflen = http_line(data);
     if (request->buflen < 0) {
-        if (data->bufpos == 0 &&
-                data->buflen >= sizeof(data->buf) - 1) {
+        if (data->bufpos == 0 && data->buflen >= data->bufsize - 1) {
+            if (http_buf_grow(data)) {
+                return true;
+            }
             http_error(sess, 414, "URI Too Long");
             sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
         };
@@ -363,76 +1117,54 @@ static bool request_begin(ews_sess_t *sess)
     data->buflen -= request->buflen + 2;
     data->bufpos += request->buflen + 2;
 
-    /// parse request
-    sess->data.path = NULL;
-    p = (char *) request->buf;
-    while (*p) {
-        if (isspace(*p)) {
-            *p++ = '\0';
-            while (isspace(*p)) {
-                p++;
-            }
-            if (sess->data.path == NULL) {
-                sess->data.path = p;
-            } else if (version == NULL) {
-                version = p;
-            }
-        }
-        p++;
-    }
-    if (sess->data.path == NULL) {
+    /// parse request: a token method, a path and an optional version
+    end = (char *) &request->buf[request->buflen];
+    len = ews_scan_token(request->buf, request->buflen);
+    p = (char *) &request->buf[len];
+    if (len == 0 || (*p != ' ' && *p != '\t')) {
         http_error(sess, 400, "Bad Request");
         sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
         return true;
     }
-
-    p = (char *) request->buf;
-    while (*p) {
-        *p = toupper(*p);
+    sess->data.method = http_method(request->buf, len);
+    *p++ = '\0';
+    while (*p == ' ' || *p == '\t') {
         p++;
     }
-
-    const struct methods {
-        const char *name;
-        uint8_t id;
-    } methods[] = {
-        {"GET",     EWS_SESS_METHOD_GET},
-        {"POST",    EWS_SESS_METHOD_POST},
-        {"OPTIONS", EWS_SESS_METHOD_OPTIONS},
-        {"HEAD",    EWS_SESS_METHOD_HEAD},
-#if CONFIG_EWS_RARE_METHODS
-        {"CONNECT", EWS_SESS_METHOD_CONNECT},
-        {"DELETE",  EWS_SESS_METHOD_DELETE},
-        {"PATCH",   EWS_SESS_METHOD_PATCH},
-        {"PUT",     EWS_SESS_METHOD_PUT},
-        {"TRACE",   EWS_SESS_METHOD_TRACE},
-#endif
-        {NULL,      EWS_SESS_METHOD_OTHER},
-    };
-
-    const struct methods *method = methods;
-    while (method->name != NULL) {
-        if (strcmp((char *) request->buf, method->name) == 0) {
-            break;
+    sess->data.path = p;
+    if (p == end) {
+        http_error(sess, 400, "Bad Request");
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return true;
+    }
+    p = memchr(p, ' ', end - p);
+    if (p) {
+        path_end = p;
+        *p++ = '\0';
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (p < end) {
+            version = p;
         }
-        method++;
+    } else {
+        path_end = end;
     }
-    sess->data.method = method->id;
 
-    parse_path(&sess->data);
+    parse_path(&sess->data, path_end - sess->data.path);
 
-    /// determine HTTP version
+    /// determine HTTP version, one word compare
     if (version) {
-        p = version;
-        while (*p) {
-            *p = toupper(*p);
-            p++;
-        }
+        uint64_t word = 0;
 
-        if (strcmp(version, "HTTP/1.1") == 0) {
+        if (end - version == sizeof(word)) {
+            word = http_word((uint8_t *) version, sizeof(word)) &
+                    HTTP_VERSION_UPPER;
+        }
+        if (word == HTTP_WORD("HTTP/1.1")) {
             data->block.version = EWS_HTTP_VERSION_11;
             data->block.flags |= EWS_HTTP_FLAGS_KEEPALIVE;
-        } else if (strcmp(version, "HTTP/1.0") == 0) {
+        } else if (word == HTTP_WORD("HTTP/1.0")) {
             data->block.version = EWS_HTTP_VERSION_10;
         } else {
             http_error(sess, 505, "HTTP Version Not Supported");
@@ -463,6 +1195,27 @@ static bool request_begin(ews_sess_t *sess)
         call_handler(sess);
     }
 
+    /// early data may be replayed, only idempotent methods are safe
+    if (sess->data.early_data &&
+            !(data->block.route->flags & EWS_ROUTE_FLAG_EARLY_DATA)) {
+        switch (sess->data.method) {
+        case EWS_SESS_METHOD_GET:
+        case EWS_SESS_METHOD_HEAD:
+        case EWS_SESS_METHOD_OPTIONS:
+        case EWS_SESS_METHOD_TRACE:
+        case EWS_SESS_METHOD_PUT:
+        case EWS_SESS_METHOD_DELETE:
+            break;
+
+        default:
+            /// past request begin so the handler sees its finalize
+            data->block.state = EWS_SESS_REQUEST_HEADER;
+            http_error(sess, 425, "Too Early");
+            sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+            return true;
+        }
+    }
+
     if (data->block.version == EWS_HTTP_VERSION_09) {
         data->block.state = EWS_SESS_RESPONSE_BEGIN;
     } else {
@@ -480,10 +1233,14 @@ static bool request_header(ews_sess_t *sess)
     ssize_t len;
 
     request->buf = &data->buf[data->bufpos];
-    request->buflen = find(request->buf, data->buflen, "\r\n");
+    request->buflen = http_line(data);
     if (request->buflen < 0) {
-        if (data->bufpos == 0 &&
-                data->buflen >= sizeof(data->buf) - 1) {
+        /// the whole head counts, it stays in the buffer
+        if (data->head == 0 &&
+                data->bufpos + data->buflen >= data->bufsize - 1) {
+            if (http_buf_grow(data)) {
+                return true;
+            }
             http_error(sess, 431, "Request Header Fields Too Large");
             sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
         };
@@ -494,7 +1251,8 @@ static bool request_header(ews_sess_t *sess)
     data->bufpos += request->buflen + 2;
 
     if (request->buflen == 0) {
-        if (request->length != SIZE_MAX ||
+        data->head_len = data->bufpos - data->head;
+        if ((request->length != SIZE_MAX && request->length > 0) ||
                 data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED) {
             data->block.state = EWS_SESS_REQUEST_BODY;
             return false;
@@ -503,138 +1261,387 @@ static bool request_header(ews_sess_t *sess)
         return false;
     }
 
-    sess->data.name = (char *) request->buf;
-    len = find(request->buf, request->buflen, ": ");
-    if (len < 1) {
-        http_error(sess, 400, "Invalid Header");
-        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+    /// the name is a token directly followed by the colon
+    sess->data.name = (char *) request->buf;
+    len = ews_scan_token(request->buf, request->buflen);
+    if (len < 1 || len == request->buflen || request->buf[len] != ':') {
+        http_error(sess, 400, "Bad Request");
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return true;
+    }
+    sess->data.name_len = len;
+    sess->data.header_id = ews_header_lookup(sess->data.name, len);
+    request->buf[len] = '\0';
+
+    sess->data.value = (char *) &request->buf[len + 1];
+    while (*sess->data.value == ' ' || *sess->data.value == '\t') {
+        sess->data.value++;
+    }
+    len = (char *) &request->buf[request->buflen] - sess->data.value;
+    sess->data.value_len = len;
+
+    if (data->block.header_count == data->block.header_cap &&
+            data->block.header_cap < CONFIG_EWS_SESSION_HEADERS) {
+        /// the old table stays in the arena until finalize
+        size_t cap = MIN(MAX(data->block.header_cap * 2, (size_t) 16),
+                (size_t) CONFIG_EWS_SESSION_HEADERS);
+        ews_http_header_t *headers = http_alloc(sess,
+                sizeof(*headers) * cap);
+        if (headers) {
+            if (data->block.header_count > 0) {
+                memcpy(headers, data->block.headers,
+                        sizeof(*headers) * data->block.header_count);
+            }
+            data->block.headers = headers;
+            data->block.header_cap = cap;
+        }
+    }
+    if (data->block.header_count < data->block.header_cap) {
+        ews_http_header_t *header =
+                &data->block.headers[data->block.header_count++];
+        const uint8_t *head = &data->buf[data->head];
+        header->name = (uint8_t *) sess->data.name - head;
+        header->name_len = sess->data.name_len;
+        header->value = (uint8_t *) sess->data.value - head;
+        header->value_len = sess->data.value_len;
+        header->id = sess->data.header_id;
+    } else {
+        LOGD("#%d header %s not kept", sock->fd, sess->data.name);
+    }
+
+    switch (sess->data.header_id) {
+    case EWS_HEADER_CONNECTION:
+        if (strstr(sess->data.value, "close")) {
+            data->block.flags &= ~EWS_HTTP_FLAGS_KEEPALIVE;
+        } else if (strstr(sess->data.value, "keep-alive")) {
+            data->block.flags |= EWS_HTTP_FLAGS_KEEPALIVE;
+        }
+        break;
+
+    case EWS_HEADER_CONTENT_LENGTH:
+        if (!(data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED)) {
+            request->length = strtol(sess->data.value, NULL, 10);
+        }
+        break;
+
+    case EWS_HEADER_TRANSFER_ENCODING:
+        if (strstr(sess->data.value, "chunked") == NULL) {
+            goto done;
+        }
+        data->block.flags |= EWS_HTTP_FLAGS_REQUEST_CHUNKED;
+        request->chunked_state = EWS_HTTP_CHUNKED_SIZE;
+        request->length = SIZE_MAX;
+        break;
+
+    case EWS_HEADER_EXPECT:
+        if (strcasecmp(sess->data.value, "100-continue") != 0) {
+            http_error(sess, 417, "Expectation Failed");
+            sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+            return true;
+        }
+        /// HTTP/1.0 clients do not know interim responses
+        if (data->block.version == EWS_HTTP_VERSION_11) {
+            data->block.flags |= EWS_HTTP_FLAGS_EXPECT_CONTINUE;
+        }
+        break;
+
+    case EWS_HEADER_CONTENT_TYPE: {
+        char *p;
+        if ((p = strstr(sess->data.value, "multipart/form-data;")) == NULL) {
+            goto done;
+        }
+        if ((p = strstr(p, "boundary=")) == NULL) {
+            goto done;
+        }
+        p += 9;
+        size_t len = strlen(p);
+        if (len >= 2 && *p == '"' && p[len - 1] == '"') {
+            len -= 2;
+            p++;
+        }
+        request->boundary = (uint8_t *) p - &data->buf[data->head];
+        request->boundary_len = len;
+        data->block.flags |= EWS_HTTP_FLAGS_REQUEST_MULTIPART;
+        LOGV("#%d boundary %.*s", sock->fd, (int) len, p);
+        break;
+    }
+
+    default:
+        break;
+    }
+
+done:
+    /// the server acts on the protocol headers itself, the handler only
+    /// sees the ones its route asked for
+    if (ews_route_wants_header(data->block.route, sess->data.header_id,
+            sess->data.name, sess->data.name_len)) {
+        call_handler(sess);
+    }
+
+    return false;
+}
+
+static const uint8_t *http_bws(const uint8_t *p, const uint8_t *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+/// parse a chunk size line; extensions are checked for their syntax and
+/// otherwise ignored
+static bool http_chunk_size(const uint8_t *p, size_t len, size_t *size)
+{
+    const uint8_t *end = p + len;
+    size_t n = 0;
+    int v;
+
+    if (p == end || ews_scan_hex(*p) < 0) {
+        return false;
+    }
+    for (; p < end && (v = ews_scan_hex(*p)) >= 0; p++) {
+        if (n > SIZE_MAX >> 4) {
+            return false;
+        }
+        n = n << 4 | v;
+    }
+
+    /// *( BWS ";" BWS ext-name [ BWS "=" BWS ext-val ] )
+    while ((p = http_bws(p, end)) < end) {
+        if (*p++ != ';') {
+            return false;
+        }
+        p = http_bws(p, end);
+        len = ews_scan_token(p, end - p);
+        if (len == 0) {
+            return false;
+        }
+        p = http_bws(p + len, end);
+        if (p == end || *p != '=') {
+            continue;
+        }
+        p = http_bws(p + 1, end);
+        if (p < end && *p == '"') {
+            /// quoted-string, a backslash escapes the next character
+            for (p++; p < end && *p != '"'; p++) {
+                if (*p == '\\' && ++p == end) {
+                    return false;
+                }
+            }
+            if (p == end) {
+                return false;
+            }
+            p++;
+        } else {
+            len = ews_scan_token(p, end - p);
+            if (len == 0) {
+                return false;
+            }
+            p += len;
+        }
+    }
+
+    *size = n;
+    return true;
+}
+
+/// keep a trailer line in the arena, the buffer is reused for the next
+/// request before the handler is done
+static bool request_trailer(ews_sess_t *sess, uint8_t *line, size_t line_len)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ews_http_trailer_t *trailer, **tail;
+    const uint8_t *value, *end = line + line_len;
+    size_t len;
+    char *p;
+
+    len = ews_scan_token(line, line_len);
+    if (len < 1 || len == line_len || line[len] != ':') {
+        return false;
+    }
+    value = http_bws(&line[len + 1], end);
+
+    if (data->block.trailer_count >= CONFIG_EWS_SESSION_HEADERS) {
+        LOGD("#%d trailer %.*s not kept", sess->sock->fd, (int) len, line);
+        return true;
+    }
+    trailer = http_alloc(sess, sizeof(*trailer) + len + 1 + (end - value) + 1);
+    if (trailer == NULL) {
+        LOGD("#%d trailer %.*s not kept", sess->sock->fd, (int) len, line);
         return true;
     }
-    sess->data.name_len = len;
-    request->buf[len] = '\0';
 
-    sess->data.value = (char *) &request->buf[len + 1];
-    while (isspace(*sess->data.value)) {
-        sess->data.value++;
+    p = (char *) (trailer + 1);
+    memcpy(p, line, len);
+    p[len] = '\0';
+    trailer->name = p;
+    p += len + 1;
+    memcpy(p, value, end - value);
+    p[end - value] = '\0';
+    trailer->value = p;
+    trailer->next = NULL;
+
+    for (tail = &data->block.trailers; *tail; tail = &(*tail)->next) {
     }
-    len = (char *) &request->buf[request->buflen] - sess->data.value;
-    sess->data.value_len = len;
+    *tail = trailer;
+    data->block.trailer_count++;
+    return true;
+}
 
-    if (strcasecmp(sess->data.name, "Connection") == 0) {
-        if (strstr(sess->data.value, "close")) {
-            data->block.flags &= ~EWS_HTTP_FLAGS_KEEPALIVE;
-        } else if (strstr(sess->data.value, "keep-alive")) {
-            data->block.flags |= EWS_HTTP_FLAGS_KEEPALIVE;
-        }
-    } else if (strcasecmp(sess->data.name, "Content-Length") == 0) {
-        if (!(data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED)) {
-            request->length = strtol(sess->data.value, NULL, 10);
-        }
-    } else if (strcasecmp(sess->data.name, "Transfer-Encoding") == 0) {
-        if (strstr(sess->data.value, "chunked") == NULL) {
-            goto done;
-        }
-        data->block.flags |= EWS_HTTP_FLAGS_REQUEST_CHUNKED;
-        data->block.flags |= EWS_HTTP_FLAGS_REQUEST_CHUNKED_LINE;
-        request->length = SIZE_MAX;
-    } else if (strcasecmp(sess->data.name, "Content-Type") == 0) {
-        char *p;
-        if ((p = strstr(sess->data.value, "multipart/form-data;")) == NULL) {
-            goto done;
-        }
-        if ((p = strstr(p, "boundary=")) == NULL) {
-            goto done;
+/// the chunked framing around the data: size lines, the CRLF after each
+/// chunk and the trailer section
+static bool request_chunked(ews_sess_t *sess)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ews_http_request_t *request = &data->block.request;
+    ssize_t pos;
+
+    request->buf = &data->buf[data->bufpos];
+
+    if (request->chunked_state == EWS_HTTP_CHUNKED_DATA_END) {
+        if (data->buflen < 2) {
+            return true;
         }
-        p += 9;
-        size_t len = strlen(p);
-        if (*p == '"') {
-            p[len - 1] = '\0';
-            len -= 2;
-            p++;
+        if (request->buf[0] != '\r' || request->buf[1] != '\n') {
+            goto bad;
         }
-        data->block.request.boundary = strdup(p);
-        if (data->block.request.boundary == NULL) {
-            http_error(sess, 500, "Internal Server Error");
-            sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
-            return true;
+        data->bufpos += 2;
+        data->buflen -= 2;
+        request->chunked_state = EWS_HTTP_CHUNKED_SIZE;
+        return false;
+    }
+
+    pos = http_line(data);
+    if (pos < 0) {
+        /// a size line or trailer that fills the compacted buffer, only the
+        /// request head is kept in front of it
+        if (data->head == 0 && data->bufpos == data->head_len &&
+                data->bufpos + data->buflen >= data->bufsize - 1) {
+            if (http_buf_grow(data)) {
+                return true;
+            }
+            if (request->chunked_state == EWS_HTTP_CHUNKED_TRAILER) {
+                http_error(sess, 431, "Request Header Fields Too Large");
+                sess->sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+                return true;
+            }
+            goto bad;
         }
-        data->block.request.boundary_len = len;
-        data->block.flags |= EWS_HTTP_FLAGS_REQUEST_MULTIPART;
-        printf("%s\n", p);
+        return true;
     }
+    data->bufpos += pos + 2;
+    data->buflen -= pos + 2;
 
-done:
-    call_handler(sess);
+    if (request->chunked_state == EWS_HTTP_CHUNKED_SIZE) {
+        if (!http_chunk_size(request->buf, pos, &request->chunked_size)) {
+            goto bad;
+        }
+        request->chunked_pos = 0;
+        /// the last chunk is empty, trailers follow
+        request->chunked_state = request->chunked_size > 0 ?
+                EWS_HTTP_CHUNKED_DATA : EWS_HTTP_CHUNKED_TRAILER;
+        return false;
+    }
 
+    /// an empty line ends the trailer section and with it the body, any
+    /// bytes after it belong to the next request
+    if (pos == 0) {
+        data->block.state = EWS_SESS_RESPONSE_BEGIN;
+        return false;
+    }
+    if (!request_trailer(sess, request->buf, pos)) {
+        goto bad;
+    }
     return false;
+
+bad:
+    http_error(sess, 400, "Bad Request");
+    sess->sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+    return true;
 }
 
 static bool request_body(ews_sess_t *sess)
 {
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
     ews_http_request_t *request = &data->block.request;
-    size_t len;
+    bool chunked = data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED;
+    size_t avail, len;
 
-    request->buf = &data->buf[data->bufpos];
-    if (data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED) {
-        /// we expect a \r\n sequence
-        if (data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED_LINE) {
-            ssize_t pos = find(request->buf, data->buflen, "\r\n");
-            /// no \r\n sequence, fetch more data
-            if (pos < 0) {
-                return true;
-            /// we found a \r\n sequence
-            } else if (pos == 0) {
-                /// look for a terminating sequence
-                pos = find(request->buf + 2, data->buflen - 2, "0\r\n\r\n");
-                /// found it, continue to next state
-                if (pos == 0) {
-                    data->bufpos += 2;
-                    data->buflen -= 2;
-                    data->block.state = EWS_SESS_RESPONSE_BEGIN;
-                }
-                return true;
-            /// we found a hex number and \r\n sequence
-            } else if (pos <= 8) {
-                request->buf[pos] = '\0';
-                request->chunked_size = strtoul((char *) request->buf, NULL,
-                        16);
-                request->chunked_pos = 0;
-                data->bufpos += pos + 2;
-                data->buflen -= pos + 2;
-                data->block.flags &= ~EWS_HTTP_FLAGS_REQUEST_CHUNKED_LINE;
-                return false;
-            /// anything else is an error
-            } else {
-                http_error(sess, 400, "Bad Request");
-                sess->sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
-                return true;
-            }
-        } else {
-            if (data->buflen < MIN(sizeof(data->buf),
-                    request->chunked_size - request->chunked_pos)) {
+    if (__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+
+    if ((data->block.route->flags & EWS_ROUTE_FLAG_NO_BODY) &&
+            (data->block.flags & EWS_HTTP_FLAGS_EXPECT_CONTINUE) &&
+            data->buflen == 0) {
+        /// the client waits for a go-ahead that never comes, so the response
+        /// goes out now; whether the body follows it is up to the client,
+        /// so nothing after it can be parsed
+        data->block.flags &= ~(EWS_HTTP_FLAGS_EXPECT_CONTINUE |
+                EWS_HTTP_FLAGS_KEEPALIVE);
+        data->block.state = EWS_SESS_RESPONSE_BEGIN;
+        return true;
+    }
+
+    if (data->block.flags & EWS_HTTP_FLAGS_EXPECT_CONTINUE) {
+        if (data->buflen == 0 && data->block.prev_state !=
+                EWS_SESS_REQUEST_BODY) {
+            /// an empty chunk lets the handler turn the body down before
+            /// the client sends it
+            sess->data.chunk = (char *) &data->buf[data->bufpos];
+            sess->data.chunk_len = 0;
+            call_handler(sess);
+            if (data->block.state != EWS_SESS_REQUEST_BODY ||
+                    __atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
                 return true;
             }
-            sess->data.chunk = (char *) request->buf;
-            sess->data.chunk_len = MIN(data->buflen,
-                    request->chunked_size - request->chunked_pos);
         }
+        data->block.flags &= ~EWS_HTTP_FLAGS_EXPECT_CONTINUE;
+        /// a client that did not wait needs no go-ahead
+        if (data->buflen == 0) {
+            http_out_write(data, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+            http_flush(data);
+            return true;
+        }
+    }
+
+    if (chunked && request->chunked_state != EWS_HTTP_CHUNKED_DATA) {
+        return request_chunked(sess);
+    }
+
+    /// whatever part of the body is buffered goes to the handler right away
+    request->buf = &data->buf[data->bufpos];
+    sess->data.chunk = (char *) request->buf;
+    if (chunked) {
+        avail = MIN(data->buflen,
+                request->chunked_size - request->chunked_pos);
     } else {
-        sess->data.chunk = (char *) request->buf;
-        sess->data.chunk_len = MIN(data->buflen, request->length);
+        avail = MIN(data->buflen, request->length);
     }
+    sess->data.chunk_len = avail;
 
-    call_handler(sess);
+    if (data->block.route->flags & EWS_ROUTE_FLAG_NO_BODY) {
+        sess->data.chunk_len = 0;
+    } else {
+        call_handler(sess);
+        if (data->block.state != EWS_SESS_REQUEST_BODY) {
+            return true;
+        }
+    }
 
-    if (data->block.flags & EWS_HTTP_FLAGS_REQUEST_CHUNKED) {
-        len = MIN(data->buflen, request->chunked_size -
-                request->chunked_pos) - sess->data.chunk_len;
+    len = avail - sess->data.chunk_len;
+    /// a handler that reads nothing ignores the chunk, waiting for more
+    /// would stall once the buffer holds nothing else
+    if (len == 0 && !__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
+        len = avail;
+    }
+    if (chunked) {
         request->chunked_pos += len;
         if (request->chunked_pos == request->chunked_size) {
-            data->block.flags |= EWS_HTTP_FLAGS_REQUEST_CHUNKED_LINE;
+            request->chunked_state = EWS_HTTP_CHUNKED_DATA_END;
         }
-    } else if (request->length != SIZE_MAX) {
-        len = MIN(data->buflen, request->length) - sess->data.chunk_len;
+    } else {
         request->length -= len;
         if (request->length == 0) {
             data->block.state = EWS_SESS_RESPONSE_BEGIN;
@@ -643,7 +1650,13 @@ static bool request_body(ews_sess_t *sess)
     data->bufpos += len;
     data->buflen -= len;
 
-    return data->buflen == 0;
+    /// leave the rest in the buffer, the socket is not read while paused
+    if (__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+
+    /// data the handler left is offered again right away
+    return len == 0 || data->buflen == 0;
 }
 
 static void response_begin(ews_sess_t *sess)
@@ -658,7 +1671,25 @@ static void response_header(ews_sess_t *sess)
 
 static void response_body(ews_sess_t *sess)
 {
-    call_handler(sess);
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ews_http_response_t *response = &data->block.response;
+    ews_sock_t *sock = sess->sock;
+    size_t queued;
+
+    if (response->producer == NULL) {
+        call_handler(sess);
+        return;
+    }
+
+    queued = sock->ops->queued(sock) + data->out_len;
+    if (queued >= CONFIG_EWS_SEND_LOWAT) {
+        return;
+    }
+
+    if (!response->producer(sess, response->producer_arg,
+            CONFIG_EWS_SEND_HIWAT - queued)) {
+        finalize(sess);
+    }
 }
 
 static void finalize(ews_sess_t *sess)
@@ -667,12 +1698,13 @@ static void finalize(ews_sess_t *sess)
     ews_sock_t *sock = sess->sock;
 
     if (data->block.state == EWS_SESS_REQUEST_BEGIN) {
+        ews_arena_reset(&data->arena, &sock->ews->bufpool);
         return;
     }
 
     if (data->block.state == EWS_SESS_RESPONSE_BODY &&
             data->block.flags & EWS_HTTP_FLAGS_RESPONSE_CHUNKED) {
-        http_raw_send(sess, "0\r\n\r\n", 5);
+        http_out_write(data, "0\r\n\r\n", 5);
     }
 
     if (data->block.route) {
@@ -681,20 +1713,82 @@ static void finalize(ews_sess_t *sess)
         data->block.route->handler(sess, data->block.state);
     }
 
+    /// the end of a response is the end of a batch of records, unless
+    /// pipelined requests follow whose responses can join it
+    if (!(data->block.flags & EWS_HTTP_FLAGS_KEEPALIVE) ||
+            data->buflen == 0 || data->out_len >= CONFIG_EWS_SEND_LOWAT) {
+        http_flush(data);
+    }
+
     if (!(data->block.flags & EWS_HTTP_FLAGS_KEEPALIVE)) {
-        sock->ops->shutdown(sock);
+        data->last = true;
+        data->buflen = 0;
+        if (data->out_len > 0) {
+            data->out_shutdown = true;
+        } else {
+            sock->ops->shutdown(sock);
+        }
+    }
+
+    ews_arena_reset(&data->arena, &sock->ews->bufpool);
+    memset(&data->block, 0, sizeof(data->block));
+    __atomic_store_n(&data->paused, 0, __ATOMIC_RELEASE);
+    /// the head of the request is no longer referenced
+    data->head = data->bufpos;
+    data->head_len = 0;
+}
+
+/// take a session from the slab; there is one per client, so the heap is
+/// only a fallback
+static ews_http_data_t *http_data_get(ews_t *ews)
+{
+    ews_http_data_t *data;
+
+    if (ews->http_free) {
+        data = ews->http_free;
+        ews->http_free = data->next;
+    } else if (ews->http_slab_used < countof(ews->http_slab)) {
+        data = &ews->http_slab[ews->http_slab_used++];
+    } else {
+        data = calloc(1, sizeof(*data));
+        if (data == NULL) {
+            return NULL;
+        }
+        ews->stats.session_allocs++;
     }
 
-    free((void *) data->block.request.boundary);
+    /// the buffer is already released and the header table is counted by
+    /// the block, so only these need clearing
+    memset(&data->sess.data, 0, sizeof(data->sess.data));
     memset(&data->block, 0, sizeof(data->block));
+    return data;
+}
+
+static void http_data_put(ews_t *ews, ews_http_data_t *data)
+{
+    if (data < ews->http_slab ||
+            data >= &ews->http_slab[countof(ews->http_slab)]) {
+        free(data);
+        return;
+    }
+
+    data->next = ews->http_free;
+    ews->http_free = data;
 }
 
 static void on_connect(ews_sock_t *sock)
 {
     sock->ops->set_block(sock, false);
-    sock->flags |= EWS_SOCK_FLAG_PROTO_HTTP | EWS_SOCK_FLAG_CONNECTED;
 
-    ews_http_data_t *data = calloc(1, sizeof(*data));
+    ews_http_data_t *data = http_data_get(sock->ews);
+    if (!data) {
+        LOGE("#%d out of sessions", sock->fd);
+        /// on_close runs on the next worker loop and sees no session
+        sock->user = NULL;
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return;
+    }
+    sock->flags |= EWS_SOCK_FLAG_PROTO_HTTP | EWS_SOCK_FLAG_CONNECTED;
     sock->user = &data->sess;
     data->sess.sock = sock;
     data->sess.ops = &http_sess_ops;
@@ -703,10 +1797,18 @@ static void on_connect(ews_sock_t *sock)
 static void on_close(ews_sock_t *sock)
 {
     ews_sess_t *sess = (ews_sess_t *) sock->user;
+    if (!sess) {
+        sock->ops->close(sock);
+        return;
+    }
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
 
     finalize(sess);
-    free(data);
+    http_buf_put(data);
+    http_out_release(data);
+    data->out_shutdown = false;
+    data->last = false;
+    http_data_put(sock->ews, data);
     sock->ops->close(sock);
 }
 
@@ -716,7 +1818,7 @@ static bool want_read(ews_sock_t *sock)
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
 
     if ((data->block.state & 0x30) == 0x00) {
-        return true;
+        return !__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE);
     }
 
     return false;
@@ -731,50 +1833,187 @@ static bool want_write(ews_sock_t *sock)
         return true;
     }
 
-    return false;
+    return data->out_len > 0 || data->out_shutdown;
 }
 
-static void do_read(ews_sock_t *sock)
+static bool pending(ews_sock_t *sock)
 {
     ews_sess_t *sess = (ews_sess_t *) sock->user;
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
-    ssize_t ret;
 
-again:
-    ret = sock->ops->recv(sock, data->buf + data->buflen,
-            sizeof(data->buf) - data->buflen);
-    if (ret <= 0) {
-        return;
+    /// early data is buffered in userspace, select never reports it
+    if ((sock->flags & EWS_SOCK_FLAG_EARLY_DATA) && want_read(sock)) {
+        return true;
+    }
+
+    /// neither is plaintext TLS decrypted along with an earlier record, the
+    /// next pipelined request may be waiting there
+    if (want_read(sock) && sock->ops->avail(sock) > 0) {
+        return true;
+    }
+
+    return __atomic_load_n(&data->resumed, __ATOMIC_ACQUIRE);
+}
+
+static uint32_t idle_timeout(ews_sock_t *sock)
+{
+    ews_sess_t *sess = (ews_sess_t *) sock->user;
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+
+    /// a paused body waits on the application rather than the peer, the
+    /// longer pause timeout still reclaims a peer that went away meanwhile
+    if (__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
+        return sock->ews->config.pause_timeout;
     }
-    data->buflen += ret;
 
-    const bool (*funcs[])(ews_sess_t *sess) = {
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+    /// an idle TLS keep-alive holds an ssl context and its record buffers,
+    /// a client that comes back later resumes from its session ticket
+    if ((sock->flags & EWS_SOCK_FLAG_TLS) &&
+            data->block.state == EWS_SESS_REQUEST_BEGIN &&
+            data->buflen == 0 && data->out_len == 0) {
+        return sock->ews->config.https_keepalive_timeout;
+    }
+#endif
+
+    return sock->idle_timeout;
+}
+
+/// parse buffered requests and answer them back to back; the responses to
+/// pipelined requests are staged behind each other and go out in one write
+static void http_process(ews_sess_t *sess)
+{
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ews_sock_t *sock = sess->sock;
+    uint8_t state;
+
+    const bool (*requests[])(ews_sess_t *sess) = {
         request_begin,
         request_header,
         request_body,
     };
 
-    while (data->buflen > 0) {
-        if (funcs[data->block.state & 0xf](sess)) {
-            if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
-                return;
+    const void (*responses[])(ews_sess_t *sess) = {
+        response_begin,
+        response_header,
+        response_body,
+    };
+
+    while (!(sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) && !data->last) {
+        state = data->block.state;
+        if ((state & 0x30) == 0x10) {
+            responses[state & 0xf](sess);
+            /// an unfinished response goes on once the socket is writable
+            if (data->block.state == state) {
+                break;
             }
-            goto done;
+            continue;
+        }
+        if ((data->buflen == 0 &&
+                !(data->block.flags & EWS_HTTP_FLAGS_EXPECT_CONTINUE)) ||
+                requests[state & 0xf](sess)) {
+            break;
         }
     }
 
-done:
-    if (data->buflen == sizeof(data->buf)) {
+    http_flush(data);
+}
+
+/// headers are referenced relative to the head, which moves to the front;
+/// consumed body bytes after it are dropped
+static void http_buf_compact(ews_http_data_t *data)
+{
+    size_t keep;
+
+    switch (data->block.state) {
+    case EWS_SESS_REQUEST_BEGIN:
+        keep = 0;
+        break;
+
+    case EWS_SESS_REQUEST_HEADER:
+        keep = data->bufpos - data->head;
+        break;
+
+    default:
+        keep = data->head_len;
+        break;
+    }
+    if (data->head > 0 && keep > 0) {
+        memmove(data->buf, &data->buf[data->head], keep);
+    }
+    if (data->bufpos > keep) {
+        memmove(&data->buf[keep], &data->buf[data->bufpos], data->buflen);
+        data->early_end -= MIN(data->early_end, data->bufpos - keep);
+    }
+    data->bufpos = keep;
+    data->head = 0;
+}
+
+static void do_read(ews_sock_t *sock)
+{
+    ews_sess_t *sess = (ews_sess_t *) sock->user;
+    ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
+    ssize_t ret;
+
+    __atomic_store_n(&data->resumed, false, __ATOMIC_RELEASE);
+
+again:
+    if (data->buf == NULL && !http_buf_get(data)) {
+        LOGE("#%d out of memory for the session buffer", sock->fd);
         sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
         return;
     }
+    if (data->bufpos + data->buflen < data->bufsize) {
+        ret = sock->ops->recv(sock, &data->buf[data->bufpos + data->buflen],
+                data->bufsize - data->bufpos - data->buflen);
+        if (ret > 0) {
+            data->buflen += ret;
+            if (sock->flags & EWS_SOCK_FLAG_EARLY_DATA) {
+                data->early_end = data->bufpos + data->buflen;
+            }
+        } else if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
+            return;
+        }
+    }
+    /// nothing after a response that ended the connection is answered
+    if (data->last) {
+        data->buflen = 0;
+    }
+    if (data->buflen == 0 &&
+            !(data->block.flags & EWS_HTTP_FLAGS_EXPECT_CONTINUE)) {
+        if (data->block.state == EWS_SESS_REQUEST_BEGIN) {
+            http_buf_put(data);
+        }
+        return;
+    }
 
-    if (data->bufpos > 0) {
-        memmove(data->buf, &data->buf[data->bufpos], data->buflen);
-        data->bufpos = 0;
+parse:
+    http_process(sess);
+    if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
+        return;
+    }
+
+    http_buf_compact(data);
+
+    if (__atomic_load_n(&data->paused, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    if (data->bufpos + data->buflen == data->bufsize) {
+        /// the parser promotes the buffer or rejects the request, in the
+        /// body that is a chunk size line or trailer that does not fit
+        if ((data->block.state & 0x30) == 0x00) {
+            goto parse;
+        }
+        /// pipelined requests wait for the response ahead of them
+        return;
+    }
+
+    if (data->block.state == EWS_SESS_REQUEST_BEGIN && data->buflen == 0) {
+        http_buf_put(data);
     }
 
-    if (sock->ops->avail(sock) > 0) {
+    if ((data->block.state & 0x30) == 0x00 && sock->ops->avail(sock) > 0) {
         goto again;
     }
 }
@@ -784,13 +2023,31 @@ static void do_write(ews_sock_t *sock)
     ews_sess_t *sess = (ews_sess_t *) sock->user;
     ews_http_data_t *data = container_of(sess, ews_http_data_t, sess);
 
-    const void (*funcs[])(ews_sess_t *sess) = {
-        response_begin,
-        response_header,
-        response_body,
-    };
+    /// what is staged goes first
+    if (data->out_len > 0 && !http_out_flush(data)) {
+        return;
+    }
+
+    if (data->out_shutdown) {
+        data->out_shutdown = false;
+        sock->ops->shutdown(sock);
+        return;
+    }
+
+    /// go on with the response, then with the requests queued behind it
+    if ((data->block.state & 0x30) == 0x10) {
+        http_process(sess);
+        if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
+            return;
+        }
+        http_buf_compact(data);
+    }
 
-    funcs[data->block.state & 0xf](sess);
+    /// back to idle, unless the next request is already buffered
+    if (data->block.state == EWS_SESS_REQUEST_BEGIN && data->buf &&
+            data->buflen == 0) {
+        http_buf_put(data);
+    }
 }
 
 const ews_sock_evt_t http_sock_evt = {
@@ -798,6 +2055,81 @@ const ews_sock_evt_t http_sock_evt = {
     .on_close = on_close,
     .want_read = want_read,
     .want_write = want_write,
+    .pending = pending,
     .do_read = do_read,
     .do_write = do_write,
+    .idle_timeout = idle_timeout,
 };
+
+void ews_http_std_init(ews_http_std_t *std, const char *server)
+{
+    size_t len;
+
+    if (server == NULL) {
+        server = CONFIG_EWS_SERVER_NAME;
+    }
+    len = strlen(server);
+    if (len > CONFIG_EWS_SERVER_NAME_MAX) {
+        LOGD("server name cut to %d bytes", CONFIG_EWS_SERVER_NAME_MAX);
+        len = CONFIG_EWS_SERVER_NAME_MAX;
+    }
+
+    memcpy(std->buf, "Date: ", 6);
+    std->len = HTTP_DATE_LINE;
+    std->server = len > 0;
+    if (std->server) {
+        memcpy(&std->buf[std->len], "Server: ", 8);
+        memcpy(&std->buf[std->len + 8], server, len);
+        memcpy(&std->buf[std->len + 8 + len], "\r\n", 2);
+        std->len += 8 + len + 2;
+    }
+
+    std->time = -1;
+    ews_http_std_update(std, time(NULL));
+}
+
+/// two decimal digits of v
+static char *http_put2(char *p, unsigned int v)
+{
+    *p++ = '0' + v / 10 % 10;
+    *p++ = '0' + v % 10;
+    return p;
+}
+
+void ews_http_std_update(ews_http_std_t *std, time_t now)
+{
+    static const char days[7][4] = {
+        "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat",
+    };
+    static const char months[12][4] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+    };
+    char *p = &std->buf[6];
+    struct tm tm;
+
+    if (now == std->time || gmtime_r(&now, &tm) == NULL) {
+        return;
+    }
+    std->time = now;
+
+    /// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    memcpy(p, days[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = http_put2(p, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, months[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    p = http_put2(p, (1900 + tm.tm_year) / 100);
+    p = http_put2(p, (1900 + tm.tm_year) % 100);
+    *p++ = ' ';
+    p = http_put2(p, tm.tm_hour);
+    *p++ = ':';
+    p = http_put2(p, tm.tm_min);
+    *p++ = ':';
+    p = http_put2(p, tm.tm_sec);
+    memcpy(p, " GMT\r\n", 6);
+}
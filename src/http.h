@@ -3,7 +3,10 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <time.h>
 
+#include "arena.h"
+#include "bufpool.h"
 #include "ews_config.h"
 #include "route.h"
 #include "socket.h"
@@ -15,15 +18,27 @@ typedef enum ews_http_version ews_http_version_t;
 /// http flags type
 typedef enum ews_http_flags ews_http_flags_t;
 
+/// http chunked decoder state type
+typedef enum ews_http_chunked ews_http_chunked_t;
+
 /// http request type
 typedef struct ews_http_request ews_http_request_t;
 
 /// http response type
 typedef struct ews_http_response ews_http_response_t;
 
+/// http header type
+typedef struct ews_http_header ews_http_header_t;
+
+/// http trailer type
+typedef struct ews_http_trailer ews_http_trailer_t;
+
 /// http data type
 typedef struct ews_http_data ews_http_data_t;
 
+/// http standard headers type
+typedef struct ews_http_std ews_http_std_t;
+
 /// http version enum
 enum ews_http_version {
     EWS_HTTP_VERSION_09,
@@ -36,9 +51,21 @@ enum ews_http_flags {
     EWS_HTTP_FLAGS_FINALIZED            =  1 <<  0,
     EWS_HTTP_FLAGS_KEEPALIVE            =  1 <<  1,
     EWS_HTTP_FLAGS_REQUEST_CHUNKED      =  1 <<  2,
-    EWS_HTTP_FLAGS_REQUEST_CHUNKED_LINE =  1 <<  3,
-    EWS_HTTP_FLAGS_REQUEST_MULTIPART    =  1 <<  4,
-    EWS_HTTP_FLAGS_RESPONSE_CHUNKED     =  1 <<  5,
+    EWS_HTTP_FLAGS_REQUEST_MULTIPART    =  1 <<  3,
+    EWS_HTTP_FLAGS_RESPONSE_CHUNKED     =  1 <<  4,
+    EWS_HTTP_FLAGS_EXPECT_CONTINUE      =  1 <<  5,
+};
+
+/// http chunked decoder state enum
+enum ews_http_chunked {
+    /// chunk size line with optional extensions
+    EWS_HTTP_CHUNKED_SIZE,
+    /// chunk data
+    EWS_HTTP_CHUNKED_DATA,
+    /// CRLF after the chunk data
+    EWS_HTTP_CHUNKED_DATA_END,
+    /// trailer lines after the last chunk, up to an empty line
+    EWS_HTTP_CHUNKED_TRAILER,
 };
 
 /// http request struct
@@ -48,36 +75,117 @@ struct ews_http_request {
 
     size_t length;
 
+    uint8_t chunked_state;
     size_t chunked_size;
     size_t chunked_pos;
 
-    const char *boundary;
+    /// multipart boundary, an offset from the request start as the head
+    /// stays in the buffer
+    size_t boundary;
     size_t boundary_len;
 };
 
 /// http response struct
 struct ews_http_response {
     size_t length;
+
+    ews_sess_producer_t producer;
+    void *producer_arg;
+};
+
+/// http header struct, offsets into buf relative to the request start
+struct ews_http_header {
+    uint16_t name, name_len;
+    uint16_t value, value_len;
+    uint8_t id;
+};
+
+/// http trailer struct, copied to the arena as the body is decoded
+struct ews_http_trailer {
+    ews_http_trailer_t *next;
+    const char *name;
+    const char *value;
 };
 
 /// http data struct
 struct ews_http_data {
-    uint8_t buf[CONFIG_EWS_SESSION_BUFSIZE];
+    /// pooled, NULL while the connection is idle
+    uint8_t *buf;
+    size_t bufsize;
+    uint8_t buftier;
     size_t bufpos;
     size_t buflen;
+    /// start of the request in buf, its head is kept until finalize
+    size_t head;
+    /// length of the request head once all headers are in
+    size_t head_len;
+    /// end of the bytes in buf that arrived as TLS early data
+    size_t early_end;
+    /// bytes after bufpos already searched for the end of the line
+    size_t scanned;
 
     ews_sess_t sess;
+    /// next free session in the slab
+    ews_http_data_t *next;
+
+    /// request scoped memory, reset at finalize
+    ews_arena_t arena;
+
+    /// response bytes staged for the socket, pooled and NULL once drained
+    uint8_t *out;
+    size_t out_size;
+    uint8_t out_tier;
+    size_t out_pos;
+    size_t out_len;
+    /// shut down once the staged bytes are out
+    bool out_shutdown;
+    /// the response did not keep the connection alive, nothing after the
+    /// request is answered
+    bool last;
+    /// token of the pause in effect, 0 while the body is read; kept out of
+    /// the block so that a resume racing finalize cannot match a later pause
+    uint32_t paused;
+    /// last token handed out, never reset so tokens stay unique across
+    /// requests and connections reusing the session
+    uint32_t pause_seq;
+    bool resumed;
 
     struct {
         uint8_t version;
         const ews_route_t *route;
         uint8_t state, prev_state, flags;
         size_t state_count;
+        ews_http_header_t *headers;
+        size_t header_count, header_cap;
+        ews_http_trailer_t *trailers;
+        size_t trailer_count;
 
         ews_http_request_t request;
         ews_http_response_t response;
     } block;
 };
 
+/// http standard headers struct, preformatted for every response head
+struct ews_http_std {
+    /// "Date: ...\r\n", then "Server: ...\r\n" unless disabled
+    char buf[sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1 +
+            sizeof("Server: \r\n") - 1 + CONFIG_EWS_SERVER_NAME_MAX];
+    size_t len;
+    /// second the date was formatted for
+    time_t time;
+    bool server;
+};
+
 /// http socket event instance
 extern const ews_sock_evt_t http_sock_evt;
+
+/// set up the standard headers
+/// @param[out] std standard headers
+/// @param[in] server Server header value, NULL for the default, empty for
+///            none
+void ews_http_std_init(ews_http_std_t *std, const char *server);
+
+/// reformat the Date header if the second has changed, worker thread only
+/// @param[in] std standard headers
+/// @param[in] now current time
+void ews_http_std_update(ews_http_std_t *std, time_t now);
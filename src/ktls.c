@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: MIT
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ews_config.h"
+
+#if CONFIG_EWS_KTLS
+# include <linux/tls.h>
+# include <mbedtls/platform_util.h>
+# include <mbedtls/ssl.h>
+#endif
+
+#include "ktls.h"
+#include "client.h"
+#include "ews_port.h"
+#include "log.h"
+
+
+#if CONFIG_EWS_KTLS
+# ifndef SOL_TLS
+#  define SOL_TLS 282
+# endif
+# ifndef TCP_ULP
+#  define TCP_ULP 31
+# endif
+
+# define KTLS_MASTER_LEN 48
+# define KTLS_RANDOM_LEN 32
+# define KTLS_KEY_MAX 32
+# define KTLS_IV_MAX 12
+
+struct ews_ktls_keys {
+    mbedtls_tls_prf_types prf;
+    unsigned char master[KTLS_MASTER_LEN];
+    /// server random followed by client random, the key expansion order
+    unsigned char random[2 * KTLS_RANDOM_LEN];
+};
+
+union ktls_crypto_info {
+    struct tls_crypto_info info;
+    struct tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+    struct tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+# if defined(TLS_CIPHER_CHACHA20_POLY1305)
+    struct tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+# endif
+};
+
+/// AEAD ciphers the kernel implements, matched against the suite name
+static const struct {
+    const char *name;
+    uint16_t cipher;
+    uint8_t key_len;
+    uint8_t iv_len;
+} ktls_ciphers[] = {
+    {"-AES-128-GCM-", TLS_CIPHER_AES_GCM_128, 16, 4},
+    {"-AES-256-GCM-", TLS_CIPHER_AES_GCM_256, 32, 4},
+# if defined(TLS_CIPHER_CHACHA20_POLY1305)
+    {"-CHACHA20-POLY1305-", TLS_CIPHER_CHACHA20_POLY1305, 32, 12},
+# endif
+};
+
+/// the Finished messages used sequence number 0 in both directions
+static const unsigned char ktls_seq[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+# if MBEDTLS_VERSION_MAJOR >= 3
+static void ktls_export_keys(void *arg, mbedtls_ssl_key_export_type type,
+        const unsigned char *secret, size_t secret_len,
+        const unsigned char client_random[32],
+        const unsigned char server_random[32],
+        mbedtls_tls_prf_types tls_prf_type)
+{
+    ews_client_tls_t *client = arg;
+    ews_ktls_keys_t *keys;
+
+    /// TLS 1.3 secrets are not supported, those sessions stay in userspace
+    if (type != MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET ||
+            secret_len != KTLS_MASTER_LEN) {
+        return;
+    }
+
+    keys = client->ktls;
+    if (keys == NULL) {
+        keys = malloc(sizeof(*keys));
+        if (keys == NULL) {
+            LOGE("malloc failed");
+            return;
+        }
+        client->ktls = keys;
+    }
+
+    keys->prf = tls_prf_type;
+    memcpy(keys->master, secret, KTLS_MASTER_LEN);
+    memcpy(&keys->random[0], server_random, KTLS_RANDOM_LEN);
+    memcpy(&keys->random[KTLS_RANDOM_LEN], client_random, KTLS_RANDOM_LEN);
+}
+# endif
+
+void ews_ktls_setup(ews_client_tls_t *client)
+{
+# if MBEDTLS_VERSION_MAJOR >= 3
+    mbedtls_ssl_set_export_keys_cb(client->ssl, ktls_export_keys, client);
+# endif
+}
+
+static size_t ktls_fill(union ktls_crypto_info *ci, uint16_t cipher,
+        const unsigned char *key, const unsigned char *iv)
+{
+    memset(ci, 0, sizeof(*ci));
+    ci->info.version = TLS_1_2_VERSION;
+    ci->info.cipher_type = cipher;
+
+    /// for GCM mbedtls uses the sequence number as the explicit nonce
+    switch (cipher) {
+    case TLS_CIPHER_AES_GCM_128:
+        memcpy(ci->aes_gcm_128.key, key, sizeof(ci->aes_gcm_128.key));
+        memcpy(ci->aes_gcm_128.salt, iv, sizeof(ci->aes_gcm_128.salt));
+        memcpy(ci->aes_gcm_128.iv, ktls_seq, sizeof(ci->aes_gcm_128.iv));
+        memcpy(ci->aes_gcm_128.rec_seq, ktls_seq,
+                sizeof(ci->aes_gcm_128.rec_seq));
+        return sizeof(ci->aes_gcm_128);
+
+    case TLS_CIPHER_AES_GCM_256:
+        memcpy(ci->aes_gcm_256.key, key, sizeof(ci->aes_gcm_256.key));
+        memcpy(ci->aes_gcm_256.salt, iv, sizeof(ci->aes_gcm_256.salt));
+        memcpy(ci->aes_gcm_256.iv, ktls_seq, sizeof(ci->aes_gcm_256.iv));
+        memcpy(ci->aes_gcm_256.rec_seq, ktls_seq,
+                sizeof(ci->aes_gcm_256.rec_seq));
+        return sizeof(ci->aes_gcm_256);
+
+# if defined(TLS_CIPHER_CHACHA20_POLY1305)
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        memcpy(ci->chacha20_poly1305.key, key,
+                sizeof(ci->chacha20_poly1305.key));
+        memcpy(ci->chacha20_poly1305.iv, iv,
+                sizeof(ci->chacha20_poly1305.iv));
+        memcpy(ci->chacha20_poly1305.rec_seq, ktls_seq,
+                sizeof(ci->chacha20_poly1305.rec_seq));
+        return sizeof(ci->chacha20_poly1305);
+# endif
+    }
+
+    return 0;
+}
+
+static size_t ktls_crypto_info(ews_ktls_keys_t *keys, const char *suite,
+        union ktls_crypto_info *tx, union ktls_crypto_info *rx)
+{
+    unsigned char kb[2 * KTLS_KEY_MAX + 2 * KTLS_IV_MAX];
+    size_t key_len = 0, iv_len = 0, len;
+    uint16_t cipher = 0;
+    int ret;
+
+    if (suite == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < countof(ktls_ciphers); i++) {
+        if (strstr(suite, ktls_ciphers[i].name)) {
+            cipher = ktls_ciphers[i].cipher;
+            key_len = ktls_ciphers[i].key_len;
+            iv_len = ktls_ciphers[i].iv_len;
+            break;
+        }
+    }
+    if (cipher == 0) {
+        return 0;
+    }
+
+    /// AEAD key block: client key, server key, client iv, server iv
+    ret = mbedtls_ssl_tls_prf(keys->prf, keys->master, sizeof(keys->master),
+            "key expansion", keys->random, sizeof(keys->random), kb,
+            2 * key_len + 2 * iv_len);
+    if (ret != 0) {
+        return 0;
+    }
+
+    len = ktls_fill(tx, cipher, &kb[key_len], &kb[2 * key_len + iv_len]);
+    ktls_fill(rx, cipher, &kb[0], &kb[2 * key_len]);
+    mbedtls_platform_zeroize(kb, sizeof(kb));
+    return len;
+}
+
+int ews_ktls_install(ews_client_tls_t *client)
+{
+    ews_sock_t *sock = &client->sock;
+    union ktls_crypto_info tx, rx;
+    int dirs = 0;
+    size_t len;
+
+    if (client->ktls == NULL) {
+        return 0;
+    }
+
+    len = ktls_crypto_info(client->ktls,
+            mbedtls_ssl_get_ciphersuite(client->ssl), &tx, &rx);
+    ews_ktls_free(client);
+    if (len == 0) {
+        LOGD("#%d kTLS: cipher suite not supported", sock->fd);
+        return 0;
+    }
+
+# if defined(TLS_RX)
+    /// both directions or none: mbedtls cannot read records the kernel has
+    /// decrypted, and alerts it writes would be encrypted a second time by
+    /// the kernel; records mbedtls already pulled off the socket would be
+    /// lost
+    if (mbedtls_ssl_check_pending(client->ssl)) {
+        goto done;
+    }
+
+    if (setsockopt(sock->fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+        LOGD("#%d kTLS: tls ulp unavailable: %s", sock->fd, strerror(errno));
+        goto done;
+    }
+
+    /// receive first, the ulp passes the send side through until it is
+    /// keyed, so a failure here leaves mbedtls in charge of both
+    if (setsockopt(sock->fd, SOL_TLS, TLS_RX, &rx, len) < 0) {
+        LOGD("#%d kTLS: TLS_RX failed: %s", sock->fd, strerror(errno));
+        goto done;
+    }
+    dirs |= EWS_KTLS_RX;
+
+    if (setsockopt(sock->fd, SOL_TLS, TLS_TX, &tx, len) < 0) {
+        LOGE("#%d kTLS: TLS_TX failed: %s", sock->fd, strerror(errno));
+        goto done;
+    }
+    dirs |= EWS_KTLS_TX;
+# else
+    LOGD("#%d kTLS: no receive offload", sock->fd);
+    goto done;
+# endif
+
+done:
+    mbedtls_platform_zeroize(&tx, sizeof(tx));
+    mbedtls_platform_zeroize(&rx, sizeof(rx));
+    return dirs;
+}
+
+void ews_ktls_free(ews_client_tls_t *client)
+{
+    if (client->ktls) {
+        mbedtls_platform_zeroize(client->ktls, sizeof(*client->ktls));
+        free(client->ktls);
+        client->ktls = NULL;
+    }
+}
+
+void ews_ktls_close_notify(ews_sock_t *sock)
+{
+    /// warning level close_notify
+    static const unsigned char alert[2] = {1, 0};
+    char ctrl[CMSG_SPACE(sizeof(unsigned char))] = {0};
+    struct iovec iov = {
+        .iov_base = (void *) alert,
+        .iov_len = sizeof(alert),
+    };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = ctrl,
+        .msg_controllen = sizeof(ctrl),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    /// alert content type
+    *CMSG_DATA(cmsg) = 21;
+
+    sendmsg(sock->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+#endif
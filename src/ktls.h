@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdbool.h>
+
+#include "ews_config.h"
+
+#include "client.h"
+
+
+#if CONFIG_EWS_KTLS
+typedef struct ews_ktls_keys ews_ktls_keys_t;
+typedef enum ews_ktls_dir ews_ktls_dir_t;
+
+enum ews_ktls_dir {
+    EWS_KTLS_TX = 1 << 0,
+    EWS_KTLS_RX = 1 << 1,
+};
+
+/// capture the key material of the handshake that is about to start
+void ews_ktls_setup(ews_client_tls_t *client);
+
+/// move record encryption into the kernel after a completed handshake
+/// @return mask of @ref ews_ktls_dir directions now handled by the kernel
+int ews_ktls_install(ews_client_tls_t *client);
+
+/// wipe captured key material
+void ews_ktls_free(ews_client_tls_t *client);
+
+/// send a close_notify alert through the kernel
+void ews_ktls_close_notify(ews_sock_t *sock);
+#endif
@@ -151,6 +151,7 @@ static void do_read(ews_sock_t *sock)
             return;
         }
 
+        ews->stats.accepts++;
         client_sock->ews = ews;
         client_sock->last_active = ews_time_ms();
         client_sock->flags |= EWS_SOCK_FLAG_INUSE | EWS_SOCK_FLAG_TYPE_CLIENT;
@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #include "route.h"
 #include "ews.h"
@@ -10,14 +11,41 @@
 #include "socket.h"
 
 
+_Static_assert(EWS_HEADER_COUNT <= 64, "header ids do not fit the mask");
+
 static bool ews_route_vappend(ews_t *ews, const char *pattern,
-        ews_route_handler_t handler, size_t argc, va_list args)
+        ews_route_handler_t handler, const ews_route_opts_t *opts,
+        size_t argc, va_list args)
 {
     ews_route_t *route = calloc(1, sizeof(*route) + sizeof(void *) * argc);
     if (route == NULL) {
         return false;
     }
 
+    if (opts) {
+        route->flags = opts->flags;
+        if (opts->header_ids) {
+            for (const ews_header_id_t *id = opts->header_ids;
+                    *id != EWS_HEADER_UNKNOWN; id++) {
+                route->header_mask |= 1ull << *id;
+            }
+            route->flags |= EWS_ROUTE_FLAG_NO_HEADERS;
+        }
+        /// well-known names are matched by id, the rest by name
+        if (opts->header_names) {
+            for (const char *const *name = opts->header_names; *name;
+                    name++) {
+                ews_header_id_t id = ews_header_lookup(*name, strlen(*name));
+                if (id != EWS_HEADER_UNKNOWN) {
+                    route->header_mask |= 1ull << id;
+                } else {
+                    route->header_names = opts->header_names;
+                }
+            }
+            route->flags |= EWS_ROUTE_FLAG_NO_HEADERS;
+        }
+    }
+
     if (ews->route_first == NULL) {
         ews->route_first = route;
     } else {
@@ -42,12 +70,47 @@ bool ews_route_append(ews_t *ews, const char *pattern,
     bool ret;
 
     va_start(args, argc);
-    ret = ews_route_vappend(ews, pattern, handler, argc, args);
+    ret = ews_route_vappend(ews, pattern, handler, NULL, argc, args);
     va_end(args);
 
     return ret;
 }
 
+bool ews_route_append_ex(ews_t *ews, const char *pattern,
+        ews_route_handler_t handler, const ews_route_opts_t *opts,
+        size_t argc, ...)
+{
+    va_list args;
+    bool ret;
+
+    va_start(args, argc);
+    ret = ews_route_vappend(ews, pattern, handler, opts, argc, args);
+    va_end(args);
+
+    return ret;
+}
+
+bool ews_route_wants_header(const ews_route_t *route, uint8_t id,
+        const char *name, size_t len)
+{
+    if (!(route->flags & EWS_ROUTE_FLAG_NO_HEADERS)) {
+        return true;
+    }
+
+    if (id != EWS_HEADER_UNKNOWN) {
+        return route->header_mask & (1ull << id);
+    }
+
+    if (route->header_names) {
+        for (const char *const *p = route->header_names; *p; p++) {
+            if (strncasecmp(*p, name, len) == 0 && (*p)[len] == '\0') {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void ews_route_clear(ews_t *ews)
 {
     assert(ews != NULL);
@@ -82,6 +145,7 @@ ews_route_status_t ews_route_404_handler(ews_sess_t *sess,
 
 const ews_route_t ews_route_404 = {
     .handler = ews_route_404_handler,
+    .flags = EWS_ROUTE_FLAG_NO_HEADERS | EWS_ROUTE_FLAG_NO_BODY,
 };
 
 ews_route_status_t ews_route_test_handler(ews_sess_t *sess,
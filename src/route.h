@@ -12,8 +12,17 @@ struct ews_route {
     ews_route_t *next;
     const char *pattern;
     ews_route_handler_t handler;
+    uint32_t flags;
+    /// well-known headers the handler wants, one bit per header id
+    uint64_t header_mask;
+    /// other headers the handler wants
+    const char *const *header_names;
     int argc;
     void *argv[0];
 };
 
 extern const ews_route_t ews_route_404;
+
+/// whether the handler of a route wants to see a request header
+bool ews_route_wants_header(const ews_route_t *route, uint8_t id,
+        const char *name, size_t len);
@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: MIT
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ews_config.h"
+
+#if CONFIG_EWS_SIMD && defined(__SSE2__)
+# define SCAN_SSE2 1
+# include <emmintrin.h>
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define SCAN_AVX2 1
+#  include <immintrin.h>
+# endif
+#endif
+#if CONFIG_EWS_SIMD && defined(__aarch64__) && defined(__ARM_NEON)
+# define SCAN_NEON 1
+# include <arm_neon.h>
+#endif
+
+#include "scan.h"
+#include "ews_port.h"
+
+
+/// RFC 9110 tchar
+static const uint8_t scan_tchar[256] = {
+    ['0' ... '9'] = 1, ['A' ... 'Z'] = 1, ['a' ... 'z'] = 1,
+    ['!'] = 1, ['#'] = 1, ['$'] = 1, ['%'] = 1, ['&'] = 1, ['\''] = 1,
+    ['*'] = 1, ['+'] = 1, ['-'] = 1, ['.'] = 1, ['^'] = 1, ['_'] = 1,
+    ['`'] = 1, ['|'] = 1, ['~'] = 1,
+};
+
+static const uint8_t scan_path_stop[256] = {
+    ['%'] = 1, ['+'] = 1, ['/'] = 1, ['?'] = 1,
+};
+
+#if SCAN_AVX2 || SCAN_NEON
+/// tchar as a bitmap indexed by the low nibble, one bit per high nibble;
+/// high nibbles 8 and up map to no bit
+# define SCAN_TCHAR_LO \
+    0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, \
+    0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70
+# define SCAN_TCHAR_HI \
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, \
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+#endif
+
+static ssize_t scan_crlf_scalar(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+
+    while ((p = memchr(p, '\r', end - p)) != NULL) {
+        if (p + 1 == end) {
+            break;
+        }
+        if (p[1] == '\n') {
+            return p - buf;
+        }
+        p++;
+    }
+    return -1;
+}
+
+static size_t scan_token_scalar(const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && scan_tchar[buf[i]]) {
+        i++;
+    }
+    return i;
+}
+
+static size_t scan_path_scalar(const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && !scan_path_stop[buf[i]]) {
+        i++;
+    }
+    return i;
+}
+
+static const ews_scan_ops_t scan_scalar_ops = {
+    .crlf = scan_crlf_scalar,
+    .token = scan_token_scalar,
+    .path = scan_path_scalar,
+};
+
+#if SCAN_SSE2
+static ssize_t scan_crlf_sse2(const uint8_t *buf, size_t len)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    ssize_t ret;
+
+    /// compare against the same block shifted by one, so a pair straddling
+    /// two blocks is still found
+    for (; i + 17 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &buf[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &buf[i + 1]);
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr),
+                _mm_cmpeq_epi8(b, lf)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    ret = scan_crlf_scalar(&buf[i], len - i);
+    return ret < 0 ? ret : (ssize_t) i + ret;
+}
+
+static size_t scan_path_sse2(const uint8_t *buf, size_t len)
+{
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i qm = _mm_set1_epi8('?');
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) &buf[i]);
+        __m128i m = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, plus)),
+                _mm_or_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(v, qm)));
+        int mask = _mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_path_scalar(&buf[i], len - i);
+}
+
+/// SSE2 has no byte shuffle for the tchar lookup, tokens are short anyway
+static const ews_scan_ops_t scan_sse2_ops = {
+    .crlf = scan_crlf_sse2,
+    .token = scan_token_scalar,
+    .path = scan_path_sse2,
+};
+#endif
+
+#if SCAN_AVX2
+__attribute__((target("avx2")))
+static ssize_t scan_crlf_avx2(const uint8_t *buf, size_t len)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    ssize_t ret;
+
+    for (; i + 33 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &buf[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &buf[i + 1]);
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    ret = scan_crlf_scalar(&buf[i], len - i);
+    return ret < 0 ? ret : (ssize_t) i + ret;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_token_avx2(const uint8_t *buf, size_t len)
+{
+    const __m256i lo_tbl = _mm256_setr_epi8(SCAN_TCHAR_LO, SCAN_TCHAR_LO);
+    const __m256i hi_tbl = _mm256_setr_epi8(SCAN_TCHAR_HI, SCAN_TCHAR_HI);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &buf[i]);
+        __m256i lo = _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_tbl,
+                _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+        uint32_t mask = _mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_token_scalar(&buf[i], len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_path_avx2(const uint8_t *buf, size_t len)
+{
+    const __m256i pct = _mm256_set1_epi8('%');
+    const __m256i plus = _mm256_set1_epi8('+');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i qm = _mm256_set1_epi8('?');
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &buf[i]);
+        __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, pct),
+                        _mm256_cmpeq_epi8(v, plus)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, slash),
+                        _mm256_cmpeq_epi8(v, qm)));
+        uint32_t mask = _mm256_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scan_path_scalar(&buf[i], len - i);
+}
+
+static const ews_scan_ops_t scan_avx2_ops = {
+    .crlf = scan_crlf_avx2,
+    .token = scan_token_avx2,
+    .path = scan_path_avx2,
+};
+#endif
+
+#if SCAN_NEON
+/// four bits per byte of a compare result, zero if nothing matched
+static inline uint64_t scan_neon_mask(uint8x16_t m)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+static ssize_t scan_crlf_neon(const uint8_t *buf, size_t len)
+{
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+    size_t i = 0;
+    ssize_t ret;
+
+    for (; i + 17 <= len; i += 16) {
+        uint8x16_t a = vld1q_u8(&buf[i]);
+        uint8x16_t b = vld1q_u8(&buf[i + 1]);
+        uint64_t mask = scan_neon_mask(vandq_u8(vceqq_u8(a, cr),
+                vceqq_u8(b, lf)));
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    ret = scan_crlf_scalar(&buf[i], len - i);
+    return ret < 0 ? ret : (ssize_t) i + ret;
+}
+
+static size_t scan_token_neon(const uint8_t *buf, size_t len)
+{
+    static const uint8_t lo_bits[16] = {SCAN_TCHAR_LO};
+    static const uint8_t hi_bits[16] = {SCAN_TCHAR_HI};
+    const uint8x16_t lo_tbl = vld1q_u8(lo_bits);
+    const uint8x16_t hi_tbl = vld1q_u8(hi_bits);
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(&buf[i]);
+        uint8x16_t lo = vqtbl1q_u8(lo_tbl, vandq_u8(v, nibble));
+        uint8x16_t hi = vqtbl1q_u8(hi_tbl, vshrq_n_u8(v, 4));
+        uint64_t mask = scan_neon_mask(vceqq_u8(vandq_u8(lo, hi),
+                vdupq_n_u8(0)));
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return i + scan_token_scalar(&buf[i], len - i);
+}
+
+static size_t scan_path_neon(const uint8_t *buf, size_t len)
+{
+    const uint8x16_t pct = vdupq_n_u8('%');
+    const uint8x16_t plus = vdupq_n_u8('+');
+    const uint8x16_t slash = vdupq_n_u8('/');
+    const uint8x16_t qm = vdupq_n_u8('?');
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(&buf[i]);
+        uint8x16_t m = vorrq_u8(
+                vorrq_u8(vceqq_u8(v, pct), vceqq_u8(v, plus)),
+                vorrq_u8(vceqq_u8(v, slash), vceqq_u8(v, qm)));
+        uint64_t mask = scan_neon_mask(m);
+        if (mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+    }
+
+    return i + scan_path_scalar(&buf[i], len - i);
+}
+
+static const ews_scan_ops_t scan_neon_ops = {
+    .crlf = scan_crlf_neon,
+    .token = scan_token_neon,
+    .path = scan_path_neon,
+};
+#endif
+
+/// the baseline of the build, usable before ews_scan_init
+#if SCAN_NEON
+const ews_scan_ops_t *ews_scan = &scan_neon_ops;
+#elif SCAN_SSE2
+const ews_scan_ops_t *ews_scan = &scan_sse2_ops;
+#else
+const ews_scan_ops_t *ews_scan = &scan_scalar_ops;
+#endif
+
+bool ews_scan_set_isa(ews_scan_isa_t isa)
+{
+    switch (isa) {
+    case EWS_SCAN_SCALAR:
+        ews_scan = &scan_scalar_ops;
+        return true;
+
+#if SCAN_SSE2
+    case EWS_SCAN_SSE2:
+        ews_scan = &scan_sse2_ops;
+        return true;
+#endif
+
+#if SCAN_AVX2
+    case EWS_SCAN_AVX2:
+        if (!__builtin_cpu_supports("avx2")) {
+            return false;
+        }
+        ews_scan = &scan_avx2_ops;
+        return true;
+#endif
+
+#if SCAN_NEON
+    case EWS_SCAN_NEON:
+        ews_scan = &scan_neon_ops;
+        return true;
+#endif
+
+    default:
+        return false;
+    }
+}
+
+const char *ews_scan_isa_name(ews_scan_isa_t isa)
+{
+    switch (isa) {
+    case EWS_SCAN_SCALAR:
+        return "scalar";
+    case EWS_SCAN_SSE2:
+        return "sse2";
+    case EWS_SCAN_AVX2:
+        return "avx2";
+    case EWS_SCAN_NEON:
+        return "neon";
+    }
+    return "unknown";
+}
+
+void ews_scan_init(void)
+{
+    static const ews_scan_isa_t order[] = {
+        EWS_SCAN_AVX2,
+        EWS_SCAN_NEON,
+        EWS_SCAN_SSE2,
+    };
+
+    for (size_t i = 0; i < countof(order); i++) {
+        if (ews_scan_set_isa(order[i])) {
+            return;
+        }
+    }
+    ews_scan_set_isa(EWS_SCAN_SCALAR);
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "ews_config.h"
+
+
+typedef enum ews_scan_isa ews_scan_isa_t;
+typedef struct ews_scan_ops ews_scan_ops_t;
+
+enum ews_scan_isa {
+    EWS_SCAN_SCALAR,
+    EWS_SCAN_SSE2,
+    EWS_SCAN_AVX2,
+    EWS_SCAN_NEON,
+};
+
+struct ews_scan_ops {
+    ssize_t (*crlf)(const uint8_t *buf, size_t len);
+    size_t (*token)(const uint8_t *buf, size_t len);
+    size_t (*path)(const uint8_t *buf, size_t len);
+};
+
+/// scanners of the selected instruction set
+extern const ews_scan_ops_t *ews_scan;
+
+/// select the widest instruction set the cpu supports
+void ews_scan_init(void);
+
+/// select an instruction set, for benchmarks
+/// @return @b false if the cpu or the build does not support it
+bool ews_scan_set_isa(ews_scan_isa_t isa);
+
+/// name of an instruction set
+const char *ews_scan_isa_name(ews_scan_isa_t isa);
+
+/// offset of the first "\r\n" in buf, -1 if there is none
+static inline ssize_t ews_scan_crlf(const uint8_t *buf, size_t len)
+{
+    return ews_scan->crlf(buf, len);
+}
+
+/// length of the run of RFC 9110 token characters at the start of buf
+static inline size_t ews_scan_token(const uint8_t *buf, size_t len)
+{
+    return ews_scan->token(buf, len);
+}
+
+/// length of the run at the start of buf that path decoding copies
+/// verbatim, up to the first '%', '+', '/' or '?'
+static inline size_t ews_scan_path(const uint8_t *buf, size_t len)
+{
+    return ews_scan->path(buf, len);
+}
+
+/// value of a hex digit, -1 for anything else
+static inline int ews_scan_hex(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
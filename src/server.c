@@ -4,17 +4,232 @@
 #include "ews_config.h"
 
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
+# include <mbedtls/cipher.h>
 # include <mbedtls/ctr_drbg.h>
+# include <mbedtls/ecp.h>
 # include <mbedtls/entropy.h>
 # include <mbedtls/error.h>
+# include <mbedtls/platform.h>
 # include <mbedtls/ssl.h>
+# include <mbedtls/ssl_cache.h>
+# include <mbedtls/ssl_ticket.h>
 # include <mbedtls/x509.h>
+# if defined(MBEDTLS_PSA_CRYPTO_C)
+#  include <psa/crypto.h>
+# endif
 #endif
 
 #include "server.h"
 #include "ews_port.h"
 #include "listener.h"
+#include "scan.h"
+#include "tlsmem.h"
+
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+/// generator of the calling thread, set by the worker and crypto threads
+static __thread mbedtls_ctr_drbg_context *tls_thread_drbg;
+
+static int tls_entropy(void *arg, unsigned char *buf, size_t len)
+{
+    ews_t *ews = arg;
+    int ret;
+
+    ews_mutex_lock(&ews->tls.entropy_mutex);
+    ret = mbedtls_entropy_func(&ews->tls.entropy_ctx, buf, len);
+    ews_mutex_unlock(&ews->tls.entropy_mutex);
+    return ret;
+}
+
+bool ews_tls_drbg_seed(ews_t *ews, mbedtls_ctr_drbg_context *drbg)
+{
+    int ret;
+
+    mbedtls_ctr_drbg_init(drbg);
+    ret = mbedtls_ctr_drbg_seed(drbg, tls_entropy, ews, NULL, 0);
+    if (ret < 0) {
+        LOGE("mbedtls_ctr_drbg_seed failed");
+        mbedtls_ctr_drbg_free(drbg);
+        return false;
+    }
+
+    if (ews->config.https_drbg_reseed_interval > 0) {
+        mbedtls_ctr_drbg_set_reseed_interval(drbg,
+                ews->config.https_drbg_reseed_interval);
+    }
+    if (ews->config.https_drbg_prediction_resistance) {
+        mbedtls_ctr_drbg_set_prediction_resistance(drbg,
+                MBEDTLS_CTR_DRBG_PR_ON);
+    }
+    return true;
+}
+
+void ews_tls_drbg_bind(mbedtls_ctr_drbg_context *drbg)
+{
+    tls_thread_drbg = drbg;
+}
+
+int ews_tls_random(void *arg, unsigned char *buf, size_t len)
+{
+    ews_t *ews = arg;
+    int ret;
+
+    if (tls_thread_drbg) {
+        return mbedtls_ctr_drbg_random(tls_thread_drbg, buf, len);
+    }
+
+    ews_mutex_lock(&ews->tls.drbg_mutex);
+    ret = mbedtls_ctr_drbg_random(&ews->tls.drbg_ctx, buf, len);
+    ews_mutex_unlock(&ews->tls.drbg_mutex);
+    return ret;
+}
+
+# if defined(MBEDTLS_SSL_CACHE_C)
+#  if MBEDTLS_VERSION_MAJOR < 3
+static int tls_cache_get(void *data, mbedtls_ssl_session *session)
+{
+    ews_t *ews = container_of((mbedtls_ssl_cache_context *) data, ews_t,
+            tls.cache_ctx);
+    int ret;
+
+    ret = mbedtls_ssl_cache_get(data, session);
+#  else
+static int tls_cache_get(void *data, unsigned char const *session_id,
+        size_t session_id_len, mbedtls_ssl_session *session)
+{
+    ews_t *ews = container_of((mbedtls_ssl_cache_context *) data, ews_t,
+            tls.cache_ctx);
+    int ret;
+
+    ret = mbedtls_ssl_cache_get(data, session_id, session_id_len, session);
+#  endif
+    if (ret == 0) {
+        ews->stats.https_cache_hits++;
+    } else {
+        ews->stats.https_cache_misses++;
+    }
+    return ret;
+}
+# endif
+
+# if defined(MBEDTLS_SSL_TICKET_C)
+static int tls_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+        unsigned char *buf, size_t len)
+{
+    ews_t *ews = container_of((mbedtls_ssl_ticket_context *) p_ticket, ews_t,
+            tls.ticket_ctx);
+    int ret;
+
+    ret = mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0) {
+        ews->stats.https_ticket_hits++;
+    } else {
+        ews->stats.https_ticket_misses++;
+    }
+    return ret;
+}
+# endif
+
+/// apply the suite, group and version choices, mbedtls keeps pointers to
+/// the lists so they are copied
+static bool tls_tune(ews_t *ews)
+{
+    mbedtls_ssl_config *cfg = &ews->tls.ssl_cfg;
+    size_t n;
+
+    if (ews->config.https_ciphersuites) {
+        for (n = 0; ews->config.https_ciphersuites[n]; n++);
+        ews->tls.ciphersuites = calloc(n + 1, sizeof(int));
+        if (ews->tls.ciphersuites == NULL) {
+            LOGE("calloc failed");
+            return false;
+        }
+        memcpy(ews->tls.ciphersuites, ews->config.https_ciphersuites,
+                n * sizeof(int));
+        mbedtls_ssl_conf_ciphersuites(cfg, ews->tls.ciphersuites);
+    }
+
+    if (ews->config.https_groups) {
+        for (n = 0; ews->config.https_groups[n]; n++);
+# if MBEDTLS_VERSION_NUMBER >= 0x03010000
+        uint16_t *groups = calloc(n + 1, sizeof(*groups));
+        if (groups == NULL) {
+            LOGE("calloc failed");
+            return false;
+        }
+        memcpy(groups, ews->config.https_groups, n * sizeof(*groups));
+        mbedtls_ssl_conf_groups(cfg, groups);
+# elif defined(MBEDTLS_ECP_C)
+        mbedtls_ecp_group_id *groups = calloc(n + 1, sizeof(*groups));
+        size_t m = 0;
+        if (groups == NULL) {
+            LOGE("calloc failed");
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            const mbedtls_ecp_curve_info *info =
+                    mbedtls_ecp_curve_info_from_tls_id(
+                    ews->config.https_groups[i]);
+            if (info) {
+                groups[m++] = info->grp_id;
+            }
+        }
+        groups[m] = MBEDTLS_ECP_DP_NONE;
+        mbedtls_ssl_conf_curves(cfg, groups);
+# else
+        void *groups = NULL;
+        LOGW("https_groups not supported");
+# endif
+        ews->tls.groups = groups;
+    }
+
+# if MBEDTLS_VERSION_NUMBER >= 0x03020000
+    if (ews->config.https_min_version) {
+        mbedtls_ssl_conf_min_tls_version(cfg, ews->config.https_min_version);
+    }
+    if (ews->config.https_max_version) {
+        mbedtls_ssl_conf_max_tls_version(cfg, ews->config.https_max_version);
+    }
+# else
+    if (ews->config.https_min_version) {
+        mbedtls_ssl_conf_min_version(cfg, MBEDTLS_SSL_MAJOR_VERSION_3,
+                ews->config.https_min_version & 0xff);
+    }
+    if (ews->config.https_max_version) {
+        mbedtls_ssl_conf_max_version(cfg, MBEDTLS_SSL_MAJOR_VERSION_3,
+                ews->config.https_max_version & 0xff);
+    }
+# endif
 
+    return true;
+}
+
+static void tls_free(ews_t *ews)
+{
+    while (ews->tls.ctx_free) {
+        ews_tls_ctx_t *ctx = ews->tls.ctx_free;
+        ews->tls.ctx_free = ctx->next;
+        mbedtls_ssl_free(&ctx->ssl);
+        mbedtls_free(ctx);
+    }
+# if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&ews->tls.ticket_ctx);
+# endif
+# if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_free(&ews->tls.cache_ctx);
+# endif
+    mbedtls_ctr_drbg_free(&ews->tls.worker_drbg);
+    mbedtls_ctr_drbg_free(&ews->tls.drbg_ctx);
+    mbedtls_entropy_free(&ews->tls.entropy_ctx);
+    mbedtls_pk_free(&ews->tls.pk_ctx);
+    mbedtls_x509_crt_free(&ews->tls.x509_crt);
+    mbedtls_ssl_config_free(&ews->tls.ssl_cfg);
+    free(ews->tls.ciphersuites);
+    free(ews->tls.groups);
+    ews_mutex_destroy(&ews->tls.drbg_mutex);
+    ews_mutex_destroy(&ews->tls.entropy_mutex);
+}
+#endif
 
 ews_t *ews_init(const ews_config_t *config)
 {
@@ -27,6 +242,7 @@ ews_t *ews_init(const ews_config_t *config)
     }
 
     ews_mutex_init(&ews->mutex, true);
+    ews_scan_init();
 
     if (config) {
         memcpy(&ews->config, config, sizeof(ews->config));
@@ -35,6 +251,11 @@ ews_t *ews_init(const ews_config_t *config)
     if (ews->config.idle_timeout <= 0) {
         ews->config.idle_timeout = CONFIG_EWS_IDLE_TIMEOUT_DFLT;
     }
+    if (ews->config.pause_timeout <= 0) {
+        ews->config.pause_timeout = CONFIG_EWS_PAUSE_TIMEOUT_DFLT;
+    }
+
+    ews_http_std_init(&ews->http_std, ews->config.server_name);
 
 #if CONFIG_EWS_HTTP_CLIENTS > 0
     if (ews->config.http_listen_port <= 0) {
@@ -60,6 +281,28 @@ ews_t *ews_init(const ews_config_t *config)
     } else if (ews->config.https_listen_backlog == 0) {
         ews->config.https_listen_backlog = CONFIG_EWS_HTTPS_BACKLOG_DFLT;
     }
+    if (ews->config.https_handshakes_max <= 0) {
+        ews->config.https_handshakes_max = CONFIG_EWS_HTTPS_HANDSHAKES_DFLT;
+    }
+    if (ews->config.https_session_cache_size == 0) {
+        ews->config.https_session_cache_size =
+                CONFIG_EWS_HTTPS_SESSION_CACHE_DFLT;
+    }
+    if (ews->config.https_session_cache_ttl <= 0) {
+        ews->config.https_session_cache_ttl = CONFIG_EWS_HTTPS_SESSION_TTL_DFLT;
+    }
+    if (ews->config.https_ticket_lifetime == 0) {
+        ews->config.https_ticket_lifetime =
+                CONFIG_EWS_HTTPS_TICKET_LIFETIME_DFLT;
+    }
+    if (ews->config.https_keepalive_timeout <= 0) {
+        ews->config.https_keepalive_timeout =
+                CONFIG_EWS_HTTPS_KEEPALIVE_TIMEOUT_DFLT;
+    }
+
+    ews_tlsmem_seal();
+    ews_mutex_init(&ews->tls.entropy_mutex, false);
+    ews_mutex_init(&ews->tls.drbg_mutex, false);
 
     if (ews->config.https_crt) {
         int ret;
@@ -69,14 +312,27 @@ ews_t *ews_init(const ews_config_t *config)
         mbedtls_pk_init(&ews->tls.pk_ctx);
         mbedtls_entropy_init(&ews->tls.entropy_ctx);
         mbedtls_ctr_drbg_init(&ews->tls.drbg_ctx);
+        mbedtls_ctr_drbg_init(&ews->tls.worker_drbg);
+# if defined(MBEDTLS_SSL_CACHE_C)
+        mbedtls_ssl_cache_init(&ews->tls.cache_ctx);
+# endif
+# if defined(MBEDTLS_SSL_TICKET_C)
+        mbedtls_ssl_ticket_init(&ews->tls.ticket_ctx);
+# endif
 
-        ret = mbedtls_ctr_drbg_seed(&ews->tls.drbg_ctx, mbedtls_entropy_func,
-                &ews->tls.entropy_ctx, NULL, 0);
-        if (ret < 0) {
-            LOGE("mbedtls_ctr_drbg_seed failed");
+        if (!ews_tls_drbg_seed(ews, &ews->tls.drbg_ctx) ||
+                !ews_tls_drbg_seed(ews, &ews->tls.worker_drbg)) {
             goto fail;
         }
 
+# if defined(MBEDTLS_PSA_CRYPTO_C)
+        /// TLS 1.3 runs on the PSA core
+        if (psa_crypto_init() != PSA_SUCCESS) {
+            LOGE("psa_crypto_init failed");
+            goto fail;
+        }
+# endif
+
         ret = mbedtls_ssl_config_defaults(&ews->tls.ssl_cfg,
                 MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
                 MBEDTLS_SSL_PRESET_DEFAULT);
@@ -85,8 +341,11 @@ ews_t *ews_init(const ews_config_t *config)
             goto fail;
         }
 
-        mbedtls_ssl_conf_rng(&ews->tls.ssl_cfg, mbedtls_ctr_drbg_random,
-                &ews->tls.drbg_ctx);
+        mbedtls_ssl_conf_rng(&ews->tls.ssl_cfg, ews_tls_random, ews);
+
+        if (!tls_tune(ews)) {
+            goto fail;
+        }
 
         ret = mbedtls_x509_crt_parse(&ews->tls.x509_crt, ews->config.https_crt,
                 ews->config.https_crt_len);
@@ -106,8 +365,7 @@ ews_t *ews_init(const ews_config_t *config)
                 ews->config.https_pk_len, NULL, 0);
 # else
         ret = mbedtls_pk_parse_key(&ews->tls.pk_ctx, ews->config.https_pk,
-                ews->config.https_pk_len, NULL, 0, mbedtls_ctr_drbg_random,
-                NULL);
+                ews->config.https_pk_len, NULL, 0, ews_tls_random, ews);
 # endif
         if (ret < 0) {
 # if LOG_LEVEL >= LOG_DEBUG
@@ -127,6 +385,53 @@ ews_t *ews_init(const ews_config_t *config)
             goto fail;
         }
 
+# if defined(MBEDTLS_SSL_CACHE_C)
+        /// session id resumption, bounded in size and entry lifetime
+        if (ews->config.https_session_cache_size > 0) {
+            mbedtls_ssl_cache_set_max_entries(&ews->tls.cache_ctx,
+                    ews->config.https_session_cache_size);
+            mbedtls_ssl_cache_set_timeout(&ews->tls.cache_ctx,
+                    ews->config.https_session_cache_ttl);
+            mbedtls_ssl_conf_session_cache(&ews->tls.ssl_cfg,
+                    &ews->tls.cache_ctx, tls_cache_get, mbedtls_ssl_cache_set);
+        }
+# endif
+
+# if defined(MBEDTLS_SSL_TICKET_C)
+        /// stateless resumption, mbedtls rotates the ticket key once per
+        /// ticket lifetime and still accepts tickets from the previous key
+        if (ews->config.https_ticket_lifetime > 0) {
+            ret = mbedtls_ssl_ticket_setup(&ews->tls.ticket_ctx,
+                    ews_tls_random, ews, MBEDTLS_CIPHER_AES_256_GCM,
+                    ews->config.https_ticket_lifetime);
+            if (ret < 0) {
+                LOGE("mbedtls_ssl_ticket_setup failed");
+                goto fail;
+            }
+            mbedtls_ssl_conf_session_tickets_cb(&ews->tls.ssl_cfg,
+                    mbedtls_ssl_ticket_write, tls_ticket_parse,
+                    &ews->tls.ticket_ctx);
+        }
+# endif
+
+# if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+        /// 0-RTT is only possible when resuming from a ticket
+        if (ews->config.https_early_data > 0 &&
+                ews->config.https_ticket_lifetime > 0) {
+            mbedtls_ssl_conf_early_data(&ews->tls.ssl_cfg,
+                    MBEDTLS_SSL_EARLY_DATA_ENABLED);
+            mbedtls_ssl_conf_max_early_data_size(&ews->tls.ssl_cfg,
+                    ews->config.https_early_data);
+        }
+# endif
+
+# if CONFIG_EWS_CRYPTO_THREADS > 0
+        /// private key operations run on the crypto pool
+        if (!ews_crypto_init(ews)) {
+            goto fail;
+        }
+# endif
+
         /// initialize https listener
         listener_init(ews, &ews->https_listener, ews->config.https_listen_port,
                 ews->config.https_listen_backlog, true);
@@ -141,12 +446,12 @@ ews_t *ews_init(const ews_config_t *config)
     return ews;
 
 fail:
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 && CONFIG_EWS_CRYPTO_THREADS > 0
+    ews_crypto_destroy(ews);
+#endif
+
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
-    mbedtls_ctr_drbg_free(&ews->tls.drbg_ctx);
-    mbedtls_entropy_free(&ews->tls.entropy_ctx);
-    mbedtls_pk_free(&ews->tls.pk_ctx);
-    mbedtls_x509_crt_free(&ews->tls.x509_crt);
-    mbedtls_ssl_config_free(&ews->tls.ssl_cfg);
+    tls_free(ews);
 #endif
 
     ews_mutex_destroy(&ews->mutex);
@@ -159,21 +464,37 @@ void ews_destroy(ews_t *ews)
     assert(ews != NULL);
 
     ews_worker_destroy(&ews->worker);
+    ews_bufpool_destroy(&ews->bufpool);
 
     // ews_route_clear(ews);
 
+#if CONFIG_EWS_HTTPS_CLIENTS > 0 && CONFIG_EWS_CRYPTO_THREADS > 0
+    ews_crypto_destroy(ews);
+#endif
+
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
-    mbedtls_ctr_drbg_free(&ews->tls.drbg_ctx);
-    mbedtls_entropy_free(&ews->tls.entropy_ctx);
-    mbedtls_pk_free(&ews->tls.pk_ctx);
-    mbedtls_x509_crt_free(&ews->tls.x509_crt);
-    mbedtls_ssl_config_free(&ews->tls.ssl_cfg);
+    tls_free(ews);
 #endif
 
     ews_mutex_destroy(&ews->mutex);
     free(ews);
 }
 
+void ews_get_stats(ews_t *ews, ews_stats_t *stats)
+{
+    assert(ews != NULL);
+    assert(stats != NULL);
+
+    memcpy(stats, &ews->stats, sizeof(*stats));
+    stats->session_buf = ews->bufpool.used;
+    stats->session_buf_pooled = ews->bufpool.pooled;
+    stats->session_allocs += ews->bufpool.allocs;
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+    ews_tlsmem_stats(&stats->https_tls_mem, &stats->https_tls_mem_peak,
+            &stats->https_tls_mem_pooled);
+#endif
+}
+
 #if CONFIG_EWS_HTTPS_CLIENTS > 0 || defined(__DOXYGEN__)
 bool ews_add_client_cert(ews_t *ews, const uint8_t *crt, size_t crt_len)
 {
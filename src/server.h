@@ -10,12 +10,17 @@
 # include <mbedtls/ctr_drbg.h>
 # include <mbedtls/entropy.h>
 # include <mbedtls/ssl.h>
+# include <mbedtls/ssl_cache.h>
+# include <mbedtls/ssl_ticket.h>
 # include <mbedtls/x509.h>
 #endif
 
+#include "bufpool.h"
 #include "client.h"
+#include "crypto.h"
 #include "ews.h"
 #include "ews_port.h"
+#include "http.h"
 #include "listener.h"
 #include "route.h"
 #include "worker.h"
@@ -38,15 +43,54 @@ struct ews {
         mbedtls_x509_crt x509_crt;
         mbedtls_pk_context pk_ctx;
         mbedtls_entropy_context entropy_ctx;
+        ews_mutex_t entropy_mutex;
+        /// for threads without a generator of their own, e.g. in ews_init
         mbedtls_ctr_drbg_context drbg_ctx;
+        ews_mutex_t drbg_mutex;
+        mbedtls_ctr_drbg_context worker_drbg;
+# if defined(MBEDTLS_SSL_CACHE_C)
+        mbedtls_ssl_cache_context cache_ctx;
+# endif
+# if defined(MBEDTLS_SSL_TICKET_C)
+        mbedtls_ssl_ticket_context ticket_ctx;
+# endif
+# if CONFIG_EWS_CRYPTO_THREADS > 0
+        ews_crypto_pool_t crypto;
+# endif
+        int handshakes;
+        /// owned copies of the configured suite and group lists
+        int *ciphersuites;
+        void *groups;
+        /// set-up ssl contexts ready for the next connection
+        ews_tls_ctx_t *ctx_free;
+        int ctx_free_count;
     } tls;
 
     ews_listener_t https_listener;
     ews_client_tls_t https_client[CONFIG_EWS_HTTPS_CLIENTS];
 #endif
 
+    ews_stats_t stats;
+
+    ews_bufpool_t bufpool;
+
+    /// Date and Server response headers, the worker keeps the date current
+    ews_http_std_t http_std;
+
+    /// sessions for all clients, recycled through the free list
+    ews_http_data_t http_slab[CONFIG_EWS_HTTP_CLIENTS +
+            CONFIG_EWS_HTTPS_CLIENTS];
+    size_t http_slab_used;
+    ews_http_data_t *http_free;
+
     ews_route_t *route_first;
     ews_route_t *route_last;
 
     ews_worker_t worker;
 };
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+int ews_tls_random(void *arg, unsigned char *buf, size_t len);
+bool ews_tls_drbg_seed(ews_t *ews, mbedtls_ctr_drbg_context *drbg);
+void ews_tls_drbg_bind(mbedtls_ctr_drbg_context *drbg);
+#endif
@@ -2,26 +2,60 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+# include <linux/sockios.h>
+# include <sys/sendfile.h>
+#endif
+
 #include "ews_config.h"
 
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
+# include <mbedtls/error.h>
 # include <mbedtls/net_sockets.h>
+# include <mbedtls/platform.h>
+# include <mbedtls/platform_util.h>
 # include <mbedtls/ssl.h>
 #endif
 
 #include "socket.h"
 #include "client.h"
+#include "crypto.h"
 #include "ews_port.h"
 #include "http.h"
+#include "ktls.h"
 #include "log.h"
 #include "server.h"
 
 
-#if CONFIG_EWS_HTTP_CLIENTS > 0
+static size_t ews_sock_queued(ews_sock_t *sock)
+{
+#if defined(SIOCOUTQNSD)
+    int queued;
+
+    if (ioctl(sock->fd, SIOCOUTQNSD, &queued) == 0) {
+        return queued;
+    }
+#endif
+    return 0;
+}
+
+static void ews_sock_set_lowat(ews_sock_t *sock)
+{
+#if defined(TCP_NOTSENT_LOWAT)
+    /// select only reports writable once unsent data drops below this
+    setsockopt(sock->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+            &(int){CONFIG_EWS_SEND_LOWAT}, sizeof(int));
+#endif
+}
+
+#if CONFIG_EWS_HTTP_CLIENTS > 0 || CONFIG_EWS_KTLS
 static ssize_t ews_sock_send(ews_sock_t *sock, const void *buf, size_t len)
 {
     ssize_t ret;
@@ -32,7 +66,7 @@ static ssize_t ews_sock_send(ews_sock_t *sock, const void *buf, size_t len)
 
     ret = send(sock->fd, buf, len, 0);
     if (ret < 0) {
-        if (errno = ECONNRESET) {
+        if (errno == ECONNRESET) {
             LOGI("connection reset by peer");
         } else if (errno == EAGAIN) {
             return -1;
@@ -65,6 +99,48 @@ static size_t ews_sock_avail(ews_sock_t *sock)
     return 0;
 }
 
+static ssize_t ews_sock_flush(ews_sock_t *sock)
+{
+    return 0;
+}
+
+static ssize_t ews_sock_sendfile(ews_sock_t *sock, int fd, off_t *offset,
+        size_t len)
+{
+    ssize_t ret;
+
+    if (sock->flags & EWS_SOCK_FLAG_SHUTDOWN) {
+        return -1;
+    }
+
+#if defined(__linux__)
+    ret = sendfile(sock->fd, fd, offset, len);
+#else
+    {
+        char buf[512];
+
+        ret = pread(fd, buf, MIN(len, sizeof(buf)), *offset);
+        if (ret <= 0) {
+            return -1;
+        }
+        ret = send(sock->fd, buf, ret, 0);
+        if (ret > 0) {
+            *offset += ret;
+        }
+    }
+#endif
+    if (ret < 0) {
+        if (errno == ECONNRESET) {
+            LOGI("connection reset by peer");
+        } else if (errno == EAGAIN) {
+            return -1;
+        }
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return -1;
+    }
+    return ret;
+}
+
 static void ews_sock_set_block(ews_sock_t *sock, bool block)
 {
     if (block) {
@@ -87,11 +163,16 @@ static void ews_sock_close(ews_sock_t *sock)
     close(sock->fd);
     memset(sock, 0, sizeof(*sock));
 }
+#endif
 
+#if CONFIG_EWS_HTTP_CLIENTS > 0
 static const struct ews_sock_ops ews_sock_ops = {
     .send = ews_sock_send,
     .recv = ews_sock_recv,
     .avail = ews_sock_avail,
+    .queued = ews_sock_queued,
+    .flush = ews_sock_flush,
+    .sendfile = ews_sock_sendfile,
     .set_block = ews_sock_set_block,
     .shutdown = ews_sock_shutdown,
     .close = ews_sock_close,
@@ -115,33 +196,287 @@ void ews_connect(ews_sock_t *sock)
     }
 #endif
 
+    ews_sock_set_lowat(sock);
     sock->idle_timeout = sock->ews->config.idle_timeout;
     sock->evt = &http_sock_evt;
 }
 #endif
 
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
-static ssize_t ews_sock_send_tls(ews_sock_t *sock, const void *buf, size_t len)
+static bool tls_ctx_get(ews_client_tls_t *client)
 {
-    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    ews_sock_t *sock = &client->sock;
+    ews_t *ews = sock->ews;
+    ews_tls_ctx_t *ctx;
     int ret;
 
-    if (sock->flags & EWS_SOCK_FLAG_SHUTDOWN) {
-        return -1;
+    /// a recycled context only needs its bio pointed at the new socket
+    ctx = ews->tls.ctx_free;
+    if (ctx) {
+        ews->tls.ctx_free = ctx->next;
+        ews->tls.ctx_free_count--;
+        goto done;
     }
 
-    ret = mbedtls_ssl_write(&client->ssl_ctx, buf, len);
+    ctx = mbedtls_calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        LOGE("calloc failed");
+        return false;
+    }
+    ctx->ews = sock->ews;
+    mbedtls_ssl_init(&ctx->ssl);
+
+    ret = mbedtls_ssl_setup(&ctx->ssl, &sock->ews->tls.ssl_cfg);
     if (ret < 0) {
+        LOGE("mbedtls_ssl_setup failed");
+        mbedtls_ssl_free(&ctx->ssl);
+        mbedtls_free(ctx);
+        return false;
+    }
+
+done:
+    ctx->next = NULL;
+    mbedtls_ssl_set_bio(&ctx->ssl, &sock->fd, mbedtls_net_send,
+            mbedtls_net_recv, NULL);
+    client->ssl = &ctx->ssl;
+    ews->stats.https_tls_contexts++;
+    return true;
+}
+
+static void tls_ctx_put(ews_client_tls_t *client)
+{
+    ews_t *ews = client->sock.ews;
+    ews_tls_ctx_t *ctx;
+
+    if (client->ssl == NULL) {
+        return;
+    }
+
+    ctx = container_of(client->ssl, ews_tls_ctx_t, ssl);
+    client->ssl = NULL;
+    ews->stats.https_tls_contexts--;
+
+    if (ews->tls.ctx_free_count < CONFIG_EWS_TLS_CTX_POOL &&
+            mbedtls_ssl_session_reset(&ctx->ssl) == 0) {
+        ctx->next = ews->tls.ctx_free;
+        ews->tls.ctx_free = ctx;
+        ews->tls.ctx_free_count++;
+        return;
+    }
+
+    mbedtls_ssl_free(&ctx->ssl);
+    mbedtls_free(ctx);
+}
+
+static int tls_out_write(ews_client_tls_t *client, bool all)
+{
+    size_t max = CONFIG_EWS_TLS_RECORD_MAX;
+    int ret;
+
+    if (client->out_len == 0) {
+        return 0;
+    }
+
+    ret = mbedtls_ssl_get_max_out_record_payload(client->ssl);
+    if (ret > 0) {
+        max = MIN(max, (size_t) ret);
+    }
+
+    while (client->out_len >= client->record_size ||
+            (all && client->out_len > 0)) {
+        size_t len = client->out_retry;
+        if (len == 0) {
+            len = MIN(MIN(client->out_len, client->record_size), max);
+        }
+
+        ret = mbedtls_ssl_write(client->ssl,
+                &client->out_buf[client->out_pos], len);
         if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
                 ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            client->out_retry = len;
+            return ret;
+        } else if (ret < 0) {
+            return ret;
+        }
+        client->out_retry = 0;
+        client->out_pos += ret;
+        client->out_len -= ret;
+        if (client->out_len == 0) {
+            client->out_pos = 0;
+        }
+
+        /// small records until the connection has proven to be a bulk
+        /// transfer, then full sized records
+        client->record_bytes += ret;
+        if (client->record_bytes >= CONFIG_EWS_TLS_RECORD_BOOST) {
+            client->record_size = CONFIG_EWS_TLS_RECORD_MAX;
+        }
+    }
+
+    return 0;
+}
+
+static bool tls_out_prepare(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    uint32_t now;
+
+    if (sock->flags & EWS_SOCK_FLAG_SHUTDOWN) {
+        return false;
+    }
+
+    /// comes from the same pool as the mbedtls record buffers
+    if (client->out_buf == NULL) {
+        client->out_buf = mbedtls_calloc(1, CONFIG_EWS_TLS_RECORD_MAX);
+        if (client->out_buf == NULL) {
+            LOGE("calloc failed");
+            sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+            return false;
+        }
+    }
+
+    /// restart slow after the connection went idle
+    now = ews_time_ms();
+    if (client->out_len == 0 &&
+            now - client->record_last > CONFIG_EWS_TLS_RECORD_IDLE_MS) {
+        client->record_size = CONFIG_EWS_TLS_RECORD_MIN;
+        client->record_bytes = 0;
+    }
+    client->record_last = now;
+    return true;
+}
+
+static size_t tls_out_space(ews_client_tls_t *client)
+{
+    if (client->out_pos + client->out_len == CONFIG_EWS_TLS_RECORD_MAX &&
+            client->out_pos > 0) {
+        memmove(client->out_buf, &client->out_buf[client->out_pos],
+                client->out_len);
+        client->out_pos = 0;
+    }
+    return CONFIG_EWS_TLS_RECORD_MAX - client->out_pos - client->out_len;
+}
+
+static bool tls_out_push(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    int ret;
+
+    ret = tls_out_write(client, false);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        sock->flags |= EWS_SOCK_FLAG_PEND_FLUSH;
+    } else if (ret < 0) {
+        if (ret == MBEDTLS_ERR_NET_CONN_RESET) {
+            LOGI("connection reset by peer");
+        }
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return false;
+    }
+    return true;
+}
+
+static ssize_t ews_sock_send_tls(ews_sock_t *sock, const void *buf, size_t len)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    const uint8_t *p = buf;
+    ssize_t total = 0;
+
+    if (!tls_out_prepare(sock)) {
+        return -1;
+    }
+
+    while (len > 0) {
+        size_t n = MIN(len, tls_out_space(client));
+        if (n == 0) {
+            break;
+        }
+
+        memcpy(&client->out_buf[client->out_pos + client->out_len], p, n);
+        client->out_len += n;
+        total += n;
+        p += n;
+        len -= n;
+
+        if (!tls_out_push(sock)) {
             return -1;
-        } else if (ret == MBEDTLS_ERR_NET_CONN_RESET) {
+        }
+    }
+
+    return total > 0 ? total : -1;
+}
+
+static ssize_t ews_sock_sendfile_tls(ews_sock_t *sock, int fd, off_t *offset,
+        size_t len)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    ssize_t total = 0;
+
+    if (!tls_out_prepare(sock)) {
+        return -1;
+    }
+
+    /// read the file straight into the record buffer
+    while (len > 0) {
+        size_t n = MIN(len, tls_out_space(client));
+        ssize_t ret;
+        if (n == 0) {
+            break;
+        }
+
+        ret = pread(fd, &client->out_buf[client->out_pos + client->out_len],
+                n, *offset);
+        if (ret <= 0) {
+            if (total == 0) {
+                return -1;
+            }
+            break;
+        }
+        client->out_len += ret;
+        *offset += ret;
+        total += ret;
+        len -= ret;
+
+        if (!tls_out_push(sock)) {
+            return -1;
+        }
+    }
+
+    return total > 0 ? total : -1;
+}
+
+static ssize_t ews_sock_flush_tls(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    int ret;
+
+    ret = tls_out_write(client, true);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        sock->flags |= EWS_SOCK_FLAG_PEND_FLUSH;
+        return client->out_len;
+    } else if (ret < 0) {
+        if (ret == MBEDTLS_ERR_NET_CONN_RESET) {
             LOGI("connection reset by peer");
         }
         sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
         return -1;
     }
-    return ret;
+
+    sock->flags &= ~EWS_SOCK_FLAG_PEND_FLUSH;
+
+    /// an idle keep-alive holds no staging buffer, the pool hands it out
+    /// again with the next response
+    mbedtls_free(client->out_buf);
+    client->out_buf = NULL;
+    client->out_pos = 0;
+    return 0;
+}
+
+static void tls_early_free(ews_client_tls_t *client)
+{
+    mbedtls_free(client->early_buf);
+    client->early_buf = NULL;
+    client->early_pos = 0;
+    client->early_len = 0;
 }
 
 static ssize_t ews_sock_recv_tls(ews_sock_t *sock, void *buf, size_t len)
@@ -149,7 +484,20 @@ static ssize_t ews_sock_recv_tls(ews_sock_t *sock, void *buf, size_t len)
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
     int ret;
 
-    ret = mbedtls_ssl_read(&client->ssl_ctx, buf, len);
+    /// early data comes first and is never merged with later records
+    if (client->early_len > 0) {
+        len = MIN(len, client->early_len);
+        memcpy(buf, &client->early_buf[client->early_pos], len);
+        client->early_pos += len;
+        client->early_len -= len;
+        if (client->early_len == 0) {
+            tls_early_free(client);
+        }
+        return len;
+    }
+    sock->flags &= ~EWS_SOCK_FLAG_EARLY_DATA;
+
+    ret = mbedtls_ssl_read(client->ssl, buf, len);
     if (ret < 0) {
         if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
                 ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
@@ -173,17 +521,26 @@ static size_t ews_sock_avail_tls(ews_sock_t *sock)
 {
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
 
-    return mbedtls_ssl_get_bytes_avail(&client->ssl_ctx);
+    if (client->ssl == NULL) {
+        return client->early_len;
+    }
+    return client->early_len + mbedtls_ssl_get_bytes_avail(client->ssl);
 }
 
-static void ews_sock_set_block_tls(ews_sock_t *sock, bool block)
+static size_t ews_sock_queued_tls(ews_sock_t *sock)
 {
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
 
+    return ews_sock_queued(sock) + client->out_len;
+}
+
+static void ews_sock_set_block_tls(ews_sock_t *sock, bool block)
+{
+    /// the bio context is the socket fd
     if (block) {
-        mbedtls_net_set_block(client->ssl_ctx.p_bio);
+        mbedtls_net_set_block((mbedtls_net_context *) &sock->fd);
     } else {
-        mbedtls_net_set_nonblock(client->ssl_ctx.p_bio);
+        mbedtls_net_set_nonblock((mbedtls_net_context *) &sock->fd);
     }
 }
 
@@ -192,7 +549,8 @@ static void ews_sock_shutdown_tls(ews_sock_t *sock)
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
 
     LOGD("#%d shutdown", sock->fd);
-    mbedtls_ssl_close_notify(&client->ssl_ctx);
+    ews_sock_flush_tls(sock);
+    mbedtls_ssl_close_notify(client->ssl);
     sock->flags |= EWS_SOCK_FLAG_SHUTDOWN;
 }
 
@@ -201,7 +559,16 @@ static void ews_sock_close_tls(ews_sock_t *sock)
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
 
     LOGI("#%d close", sock->fd);
-    mbedtls_ssl_free(&client->ssl_ctx);
+    tls_ctx_put(client);
+    tls_early_free(client);
+#if CONFIG_EWS_KTLS
+    ews_ktls_free(client);
+#endif
+    mbedtls_free(client->out_buf);
+    client->out_buf = NULL;
+    client->out_pos = 0;
+    client->out_len = 0;
+    client->out_retry = 0;
     close(sock->fd);
     memset(sock, 0, sizeof(*sock));
 }
@@ -210,43 +577,217 @@ static const struct ews_sock_ops ews_tls_sock_ops = {
     .send = ews_sock_send_tls,
     .recv = ews_sock_recv_tls,
     .avail = ews_sock_avail_tls,
+    .queued = ews_sock_queued_tls,
+    .flush = ews_sock_flush_tls,
+    .sendfile = ews_sock_sendfile_tls,
     .set_block = ews_sock_set_block_tls,
     .shutdown = ews_sock_shutdown_tls,
     .close = ews_sock_close_tls,
 };
 
-static void ews_connect_tls_task(void *arg)
+#if CONFIG_EWS_KTLS
+static void ews_sock_shutdown_ktls(ews_sock_t *sock)
+{
+    ews_ktls_close_notify(sock);
+    ews_sock_shutdown(sock);
+}
+
+/// kernel handles both directions, the ssl context is already freed
+static const struct ews_sock_ops ews_ktls_sock_ops = {
+    .send = ews_sock_send,
+    .recv = ews_sock_recv,
+    .avail = ews_sock_avail,
+    .queued = ews_sock_queued,
+    .flush = ews_sock_flush,
+    .sendfile = ews_sock_sendfile,
+    .set_block = ews_sock_set_block,
+    .shutdown = ews_sock_shutdown_ktls,
+    .close = ews_sock_close,
+};
+
+static void tls_ktls_switch(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    int dirs;
+
+    dirs = ews_ktls_install(client);
+    if (dirs == (EWS_KTLS_TX | EWS_KTLS_RX)) {
+        LOGD("#%d kTLS TX/RX", sock->fd);
+        tls_ctx_put(client);
+        sock->ops = &ews_ktls_sock_ops;
+    } else {
+        /// with only the receive side keyed the kernel decrypts records
+        /// mbedtls still expects, the connection cannot go on
+        if (dirs != 0) {
+            sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        }
+        return;
+    }
+    sock->ews->stats.https_ktls++;
+}
+#endif
+
+static void tls_handshake_on_connect(ews_sock_t *sock)
 {
-    ews_sock_t *sock = (ews_sock_t *) arg;
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    ews_t *ews = sock->ews;
+
+    /// wait for a free handshake slot, retried on every worker loop
+    if (ews->tls.handshakes >= ews->config.https_handshakes_max) {
+        return;
+    }
+
+    if (!tls_ctx_get(client)) {
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return;
+    }
+    sock->ops->set_block(sock, false);
+#if CONFIG_EWS_KTLS
+    if (ews->config.https_ktls) {
+        ews_ktls_setup(client);
+    }
+#endif
+
+    ews->tls.handshakes++;
+    client->handshake_want = MBEDTLS_ERR_SSL_WANT_READ;
+    sock->flags |= EWS_SOCK_FLAG_CONNECTED | EWS_SOCK_FLAG_HANDSHAKE;
+}
+
+static void tls_handshake_done(ews_sock_t *sock)
+{
+    if (sock->flags & EWS_SOCK_FLAG_HANDSHAKE) {
+        sock->ews->tls.handshakes--;
+        sock->flags &= ~EWS_SOCK_FLAG_HANDSHAKE;
+    }
+}
+
+static void tls_handshake_on_close(ews_sock_t *sock)
+{
+    tls_handshake_done(sock);
+    sock->ops->close(sock);
+}
+
+static bool tls_handshake_want_read(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+
+    return client->handshake_want == MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+static bool tls_handshake_want_write(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+
+    return client->handshake_want == MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+static bool tls_handshake_pending(ews_sock_t *sock)
+{
+#if CONFIG_EWS_CRYPTO_THREADS > 0 && defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+
+    /// a private key operation finished on the crypto pool
+    return client->handshake_want == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS &&
+            ews_crypto_done(client->ssl);
+#else
+    return false;
+#endif
+}
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+/// move early data out of mbedtls, the handshake only continues once the
+/// record has been read
+static int tls_early_data_read(ews_client_tls_t *client)
+{
+    ews_sock_t *sock = &client->sock;
+    size_t max = sock->ews->config.https_early_data;
     int ret;
 
-    mbedtls_ssl_init(&client->ssl_ctx);
+    /// mbedtls enforces the limit, so one buffer holds all of it
+    if (client->early_buf == NULL) {
+        client->early_buf = mbedtls_calloc(1, max);
+        if (client->early_buf == NULL) {
+            LOGE("calloc failed");
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        sock->ews->stats.https_early_data++;
+    }
 
-    ret = mbedtls_ssl_setup(&client->ssl_ctx, &sock->ews->tls.ssl_cfg);
+    ret = mbedtls_ssl_read_early_data(client->ssl,
+            &client->early_buf[client->early_len], max - client->early_len);
     if (ret < 0) {
-        LOGE("mbedtls_ssl_setup failed");
-        goto fail;
+        return ret;
     }
+    client->early_len += ret;
+    sock->flags |= EWS_SOCK_FLAG_EARLY_DATA;
+    LOGV("#%d %d bytes of early data", sock->fd, ret);
+    return 0;
+}
+#endif
 
-    mbedtls_ssl_set_bio(&client->ssl_ctx, &sock->fd, mbedtls_net_send,
-            mbedtls_net_recv, NULL);
+static void tls_handshake_step(ews_sock_t *sock)
+{
+    ews_client_tls_t *client = (ews_client_tls_t *) sock;
+    int ret;
+
+    ret = mbedtls_ssl_handshake(client->ssl);
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    while (ret == MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA) {
+        ret = tls_early_data_read(client);
+        if (ret == 0) {
+            ret = mbedtls_ssl_handshake(client->ssl);
+        }
+    }
+#endif
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        client->handshake_want = ret;
+        return;
+    }
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        client->handshake_want = ret;
+        return;
+    }
+#endif
+
+    tls_handshake_done(sock);
 
-    ret = mbedtls_ssl_handshake(&client->ssl_ctx);
     if (ret < 0) {
+# if LOG_LEVEL >= LOG_DEBUG
+        char s[128];
+        mbedtls_strerror(ret, s, sizeof(s));
+        LOGE("#%d mbedtls_ssl_handshake failed: %s", sock->fd, s);
+# else
         LOGE("mbedtls_ssl_handshake failed");
-        goto fail;
+# endif
+        sock->flags |= EWS_SOCK_FLAG_PEND_CLOSE;
+        return;
     }
 
     LOGV("#%d TLS handshake OK", sock->fd);
 
-    sock->evt = &http_sock_evt;
-    return;
+#if CONFIG_EWS_KTLS
+    tls_ktls_switch(sock);
+    if (sock->flags & EWS_SOCK_FLAG_PEND_CLOSE) {
+        return;
+    }
+#endif
 
-fail:
-    ews_sock_close_tls(sock);
+    /// hand the socket to http, its on_connect runs on the next worker loop
+    sock->flags &= ~EWS_SOCK_FLAG_CONNECTED;
+    sock->evt = &http_sock_evt;
 }
 
+static const ews_sock_evt_t tls_handshake_sock_evt = {
+    .on_connect = tls_handshake_on_connect,
+    .on_close = tls_handshake_on_close,
+    .want_read = tls_handshake_want_read,
+    .want_write = tls_handshake_want_write,
+    .pending = tls_handshake_pending,
+    .do_read = tls_handshake_step,
+    .do_write = tls_handshake_step,
+};
+
 void ews_connect_tls(ews_sock_t *sock)
 {
     ews_client_tls_t *client = (ews_client_tls_t *) sock;
@@ -267,7 +808,12 @@ void ews_connect_tls(ews_sock_t *sock)
     }
 #endif
 
+    client->record_size = CONFIG_EWS_TLS_RECORD_MIN;
+    client->record_bytes = 0;
+    client->record_last = ews_time_ms();
+
+    ews_sock_set_lowat(sock);
     sock->idle_timeout = sock->ews->config.idle_timeout;
-    ews_thread_init(&client->thread, ews_connect_tls_task, sock, 1024);
+    sock->evt = &tls_handshake_sock_evt;
 }
 #endif
@@ -29,12 +29,19 @@ enum ews_sock_flags {
     EWS_SOCK_FLAG_CONNECTED         =  1 << 10,
     EWS_SOCK_FLAG_SHUTDOWN          =  1 << 11,
     EWS_SOCK_FLAG_PEND_CLOSE        =  1 << 12,
+    EWS_SOCK_FLAG_HANDSHAKE         =  1 << 13,
+    EWS_SOCK_FLAG_PEND_FLUSH        =  1 << 14,
+    /// TLS early data is buffered, or was returned by the last recv
+    EWS_SOCK_FLAG_EARLY_DATA        =  1 << 15,
 };
 
 struct ews_sock_ops {
     ssize_t (*send)(ews_sock_t *sock, const void *buf, size_t len);
     ssize_t (*recv)(ews_sock_t *sock, void *buf, size_t len);
     size_t (*avail)(ews_sock_t *sock);
+    size_t (*queued)(ews_sock_t *sock);
+    ssize_t (*flush)(ews_sock_t *sock);
+    ssize_t (*sendfile)(ews_sock_t *sock, int fd, off_t *offset, size_t len);
     void (*set_block)(ews_sock_t *sock, bool block);
     void (*shutdown)(ews_sock_t *sock);
     void (*close)(ews_sock_t *sock);
@@ -45,8 +52,12 @@ struct ews_sock_evt {
     void (*on_close)(ews_sock_t *sock);
     bool (*want_read)(ews_sock_t *sock);
     bool (*want_write)(ews_sock_t *sock);
+    bool (*pending)(ews_sock_t *sock);
     void (*do_read)(ews_sock_t *sock);
     void (*do_write)(ews_sock_t *sock);
+    /// idle timeout for the state the connection is in, in place of
+    /// idle_timeout
+    uint32_t (*idle_timeout)(ews_sock_t *sock);
 };
 
 struct ews_sock {
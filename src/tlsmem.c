@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: MIT
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ews_config.h"
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+# include <mbedtls/platform.h>
+#endif
+
+#include "tlsmem.h"
+#include "ews.h"
+#include "ews_port.h"
+
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+# if CONFIG_EWS_TLS_MEM_POOL > 0 && defined(MBEDTLS_PLATFORM_MEMORY)
+typedef union tlsmem_hdr tlsmem_hdr_t;
+typedef struct tlsmem_free tlsmem_free_t;
+
+union tlsmem_hdr {
+    size_t size;
+    max_align_t align;
+};
+
+struct tlsmem_free {
+    tlsmem_free_t *next;
+};
+
+/// free lists of large blocks, one per distinct block size; record buffers
+/// come in only a handful of sizes
+static struct {
+    size_t size;
+    tlsmem_free_t *head;
+    int count;
+} tlsmem_class[CONFIG_EWS_TLS_MEM_CLASSES];
+
+static ews_mutex_t tlsmem_mutex;
+static bool tlsmem_ready;
+static bool tlsmem_sealed;
+static size_t tlsmem_used;
+static size_t tlsmem_peak;
+static size_t tlsmem_pooled;
+
+static void *tlsmem_calloc(size_t n, size_t size)
+{
+    tlsmem_hdr_t *hdr = NULL;
+    size_t total;
+
+    if (size != 0 && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    total = n * size;
+
+    ews_mutex_lock(&tlsmem_mutex);
+    if (total >= CONFIG_EWS_TLS_MEM_POOL_MIN) {
+        for (int i = 0; i < countof(tlsmem_class); i++) {
+            if (tlsmem_class[i].size == total && tlsmem_class[i].head) {
+                hdr = (tlsmem_hdr_t *) tlsmem_class[i].head - 1;
+                tlsmem_class[i].head = tlsmem_class[i].head->next;
+                tlsmem_class[i].count--;
+                tlsmem_pooled -= total;
+                break;
+            }
+        }
+    }
+    if (hdr) {
+        tlsmem_used += total;
+        tlsmem_peak = MAX(tlsmem_peak, tlsmem_used);
+    }
+    ews_mutex_unlock(&tlsmem_mutex);
+
+    if (hdr) {
+        memset(hdr + 1, 0, total);
+        return hdr + 1;
+    }
+
+    hdr = calloc(1, sizeof(*hdr) + total);
+    if (hdr == NULL) {
+        return NULL;
+    }
+    hdr->size = total;
+
+    ews_mutex_lock(&tlsmem_mutex);
+    tlsmem_used += total;
+    tlsmem_peak = MAX(tlsmem_peak, tlsmem_used);
+    ews_mutex_unlock(&tlsmem_mutex);
+
+    return hdr + 1;
+}
+
+static void tlsmem_release(void *ptr)
+{
+    tlsmem_hdr_t *hdr;
+    size_t total;
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    /// the allocator is installed before mbedtls allocates anything, so
+    /// every block carries a header
+    hdr = (tlsmem_hdr_t *) ptr - 1;
+    total = hdr->size;
+
+    ews_mutex_lock(&tlsmem_mutex);
+    tlsmem_used -= total;
+    if (total >= CONFIG_EWS_TLS_MEM_POOL_MIN) {
+        for (int i = 0; i < countof(tlsmem_class); i++) {
+            if (tlsmem_class[i].size == 0) {
+                tlsmem_class[i].size = total;
+            }
+            if (tlsmem_class[i].size != total) {
+                continue;
+            }
+            if (tlsmem_class[i].count < CONFIG_EWS_TLS_MEM_POOL) {
+                tlsmem_free_t *f = ptr;
+                f->next = tlsmem_class[i].head;
+                tlsmem_class[i].head = f;
+                tlsmem_class[i].count++;
+                tlsmem_pooled += total;
+                hdr = NULL;
+            }
+            break;
+        }
+    }
+    ews_mutex_unlock(&tlsmem_mutex);
+
+    free(hdr);
+}
+# endif
+
+bool ews_tls_mem_init(void)
+{
+# if CONFIG_EWS_TLS_MEM_POOL > 0 && defined(MBEDTLS_PLATFORM_MEMORY)
+    if (tlsmem_ready) {
+        return true;
+    }
+    /// blocks allocated without a header cannot be told apart later
+    assert(!tlsmem_sealed);
+    if (tlsmem_sealed) {
+        LOGE("ews_tls_mem_init called after ews_init");
+        return false;
+    }
+    ews_mutex_init(&tlsmem_mutex, false);
+    mbedtls_platform_set_calloc_free(tlsmem_calloc, tlsmem_release);
+    tlsmem_ready = true;
+    return true;
+# else
+    return false;
+# endif
+}
+
+void ews_tls_mem_destroy(void)
+{
+# if CONFIG_EWS_TLS_MEM_POOL > 0 && defined(MBEDTLS_PLATFORM_MEMORY)
+    if (!tlsmem_ready) {
+        return;
+    }
+
+    ews_mutex_lock(&tlsmem_mutex);
+    if (tlsmem_used > 0) {
+        /// live blocks carry a header that free() does not expect
+        LOGW("%zu bytes still allocated through mbedtls, allocator kept",
+                tlsmem_used);
+        ews_mutex_unlock(&tlsmem_mutex);
+        return;
+    }
+    for (int i = 0; i < countof(tlsmem_class); i++) {
+        while (tlsmem_class[i].head) {
+            tlsmem_free_t *f = tlsmem_class[i].head;
+            tlsmem_class[i].head = f->next;
+            free((tlsmem_hdr_t *) f - 1);
+        }
+        tlsmem_class[i].size = 0;
+        tlsmem_class[i].count = 0;
+    }
+    tlsmem_pooled = 0;
+    mbedtls_platform_set_calloc_free(calloc, free);
+    tlsmem_ready = false;
+    ews_mutex_unlock(&tlsmem_mutex);
+
+    ews_mutex_destroy(&tlsmem_mutex);
+# endif
+}
+
+void ews_tlsmem_seal(void)
+{
+# if CONFIG_EWS_TLS_MEM_POOL > 0 && defined(MBEDTLS_PLATFORM_MEMORY)
+    tlsmem_sealed = true;
+# endif
+}
+
+void ews_tlsmem_stats(size_t *used, size_t *peak, size_t *pooled)
+{
+# if CONFIG_EWS_TLS_MEM_POOL > 0 && defined(MBEDTLS_PLATFORM_MEMORY)
+    if (tlsmem_ready) {
+        ews_mutex_lock(&tlsmem_mutex);
+        *used = tlsmem_used;
+        *peak = tlsmem_peak;
+        *pooled = tlsmem_pooled;
+        ews_mutex_unlock(&tlsmem_mutex);
+        return;
+    }
+# endif
+    *used = 0;
+    *peak = 0;
+    *pooled = 0;
+}
+#endif
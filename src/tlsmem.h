@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+
+#include <stddef.h>
+
+#include "ews_config.h"
+
+
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+/// mark the point where the server starts allocating through mbedtls, the
+/// pooled allocator cannot be installed after it
+void ews_tlsmem_seal(void);
+
+/// bytes currently allocated, peak allocation and bytes held in the pool
+void ews_tlsmem_stats(size_t *used, size_t *peak, size_t *pooled);
+#endif
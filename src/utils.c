@@ -6,6 +6,7 @@
 #include <string.h>
 
 #include "utils.h"
+#include "ews_port.h"
 
 
 bool fnmatch(const char *pattern, const char *string)
@@ -41,24 +42,27 @@ bool fnmatch(const char *pattern, const char *string)
     }
 }
 
+/// candidates come from memchr on the first needle byte, which the C
+/// library vectorizes
 ssize_t find(const uint8_t *buf, size_t hlen, const char *s)
 {
     size_t nlen = strlen(s);
-    size_t i = 0, j = 0;
+    const uint8_t *p = buf;
+    const uint8_t *end;
 
+    if (nlen == 0) {
+        return 0;
+    }
     if (hlen < nlen) {
         return -1;
     }
 
-    while (i <= hlen - nlen) {
-        if (buf[i + j] == s[j]) {
-            if (j++ == nlen - 1) {
-                return i;
-            }
-        } else {
-            i++;
-            j = 0;
+    end = buf + hlen - nlen + 1;
+    while ((p = memchr(p, s[0], end - p)) != NULL) {
+        if (memcmp(p + 1, s + 1, nlen - 1) == 0) {
+            return p - buf;
         }
+        p++;
     }
     return -1;
 }
@@ -66,17 +70,20 @@ ssize_t find(const uint8_t *buf, size_t hlen, const char *s)
 ssize_t findp(const uint8_t *buf, size_t hlen, const char *s)
 {
     size_t nlen = strlen(s);
-    size_t i = 0, j = 0;
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + hlen;
 
-    while (i <= hlen) {
-        if (buf[i + j] == s[j]) {
-            if (j++ == nlen - 1 || i + j == hlen) {
-                return i;
-            }
-        } else {
-            i++;
-            j = 0;
+    if (nlen == 0) {
+        return 0;
+    }
+
+    /// a needle cut off by the end of the buffer counts as a match
+    while ((p = memchr(p, s[0], end - p)) != NULL) {
+        size_t len = MIN(nlen, (size_t) (end - p));
+        if (memcmp(p + 1, s + 1, len - 1) == 0) {
+            return p - buf;
         }
+        p++;
     }
     return -1;
 }
@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <sys/select.h>
+#include <time.h>
 
 #include "worker.h"
 #include "server.h"
@@ -9,23 +10,38 @@
 
 
 static void worker_task(void *arg);
-static void task_reaper(void *arg);
 
 bool ews_worker_init(ews_worker_t *worker)
 {
-    return ews_thread_init(&worker->thread, worker_task, worker,
-            CONFIG_EWS_WORKER_STACK_SIZE);
+    if (!ews_wake_init(&worker->wake)) {
+        return false;
+    }
+
+    if (!ews_thread_init(&worker->thread, worker_task, worker,
+            CONFIG_EWS_WORKER_STACK_SIZE)) {
+        ews_wake_destroy(&worker->wake);
+        return false;
+    }
+
+    return true;
 }
 
 void ews_worker_destroy(ews_worker_t *worker)
 {
-    ews_timer_init(&worker->timer, 5000, false, task_reaper, worker);
-    ews_timer_start(&worker->timer);
-    worker->shutdown = true;
+    __atomic_store_n(&worker->shutdown, true, __ATOMIC_RELEASE);
+    ews_worker_wake(worker);
+    /// nothing the worker touches may be released before it has stopped
+    ews_thread_join(&worker->thread);
+    ews_wake_destroy(&worker->wake);
+}
+
+void ews_worker_wake(ews_worker_t *worker)
+{
+    ews_wake_signal(&worker->wake);
 }
 
 static void pre_select(ews_sock_t *sock, uint32_t now, int *fd_max,
-        fd_set *rfds, fd_set *wfds)
+        fd_set *rfds, fd_set *wfds, bool *pending)
 {
     if (!(sock->flags & EWS_SOCK_FLAG_INUSE)) {
         return;
@@ -37,7 +53,13 @@ static void pre_select(ews_sock_t *sock, uint32_t now, int *fd_max,
     }
 
     if (sock->idle_timeout > 0) {
-        if (now - sock->last_active > sock->idle_timeout) {
+        uint32_t timeout = sock->idle_timeout;
+
+        if ((sock->flags & EWS_SOCK_FLAG_CONNECTED) && sock->evt &&
+                sock->evt->idle_timeout) {
+            timeout = sock->evt->idle_timeout(sock);
+        }
+        if (now - sock->last_active > timeout) {
             LOGD("#%d idle timeout", sock->fd);
             if (sock->evt && sock->evt->on_close) {
                 sock->evt->on_close(sock);
@@ -66,11 +88,15 @@ static void pre_select(ews_sock_t *sock, uint32_t now, int *fd_max,
     }
 
     if (sock->flags & EWS_SOCK_FLAG_CONNECTED) {
+        if (sock->evt->pending && sock->evt->pending(sock)) {
+            *pending = true;
+        }
         if (sock->evt->want_read && sock->evt->want_read(sock)) {
             FD_SET(sock->fd, rfds);
             *fd_max = MAX(*fd_max, sock->fd);
         }
-        if (sock->evt->want_write && sock->evt->want_write(sock)) {
+        if ((sock->flags & EWS_SOCK_FLAG_PEND_FLUSH) ||
+                (sock->evt->want_write && sock->evt->want_write(sock))) {
             FD_SET(sock->fd, wfds);
             *fd_max = MAX(*fd_max, sock->fd);
         }
@@ -81,10 +107,22 @@ static void post_select(ews_sock_t *sock, uint32_t now, fd_set *rfds,
         fd_set *wfds)
 {
     if (sock->flags & EWS_SOCK_FLAG_CONNECTED) {
-        if (FD_ISSET(sock->fd, rfds) && sock->evt->do_read) {
+        bool pending = sock->evt->pending && sock->evt->pending(sock);
+        if ((pending || FD_ISSET(sock->fd, rfds)) && sock->evt->do_read) {
             sock->last_active = now;
             sock->evt->do_read(sock);
         }
+        /// do_read may have handed the socket to another protocol
+        if (!(sock->flags & EWS_SOCK_FLAG_CONNECTED)) {
+            return;
+        }
+        if (FD_ISSET(sock->fd, wfds) &&
+                (sock->flags & EWS_SOCK_FLAG_PEND_FLUSH)) {
+            sock->last_active = now;
+            if (sock->ops->flush(sock) != 0) {
+                return;
+            }
+        }
         if (FD_ISSET(sock->fd, wfds) && sock->evt->do_write) {
             sock->last_active = now;
             sock->evt->do_write(sock);
@@ -97,35 +135,43 @@ static void worker_loop(ews_worker_t *worker)
     ews_t *ews = container_of(worker, ews_t, worker);
     struct timeval tv;
     fd_set rfds, wfds;
+    bool pending = false;
     uint32_t now;
-    int fd_max = 0;
+    int fd_max;
     int ret;
 
     now = ews_time_ms();
+    ews_http_std_update(&ews->http_std, time(NULL));
 
     FD_ZERO(&rfds);
     FD_ZERO(&wfds);
 
+    fd_max = ews_wake_fd(&worker->wake);
+    FD_SET(fd_max, &rfds);
+
 #if CONFIG_EWS_HTTP_CLIENTS > 0
-    pre_select(&ews->http_listener.sock, now, &fd_max, &rfds, &wfds);
+    pre_select(&ews->http_listener.sock, now, &fd_max, &rfds, &wfds,
+            &pending);
     for (int i = 0; i < countof(ews->http_client); i++) {
         ews_sock_t *sock = &ews->http_client[i].sock;
-        pre_select(sock, now, &fd_max, &rfds, &wfds);
+        pre_select(sock, now, &fd_max, &rfds, &wfds, &pending);
     }
 #endif
 
 #if CONFIG_EWS_HTTPS_CLIENTS > 0
-    pre_select(&ews->https_listener.sock, now, &fd_max, &rfds, &wfds);
+    pre_select(&ews->https_listener.sock, now, &fd_max, &rfds, &wfds,
+            &pending);
     for (int i = 0; i < countof(ews->https_client); i++) {
         ews_sock_t *sock = &ews->https_client[i].sock;
-        pre_select(sock, now, &fd_max, &rfds, &wfds);
+        pre_select(sock, now, &fd_max, &rfds, &wfds, &pending);
     }
 #endif
 
+    /// sockets with buffered work are serviced without waiting on select
     tv.tv_sec = 0;
-    tv.tv_usec = 100000;
+    tv.tv_usec = pending ? 0 : 100000;
     ret = select(fd_max + 1, &rfds, &wfds, NULL, &tv);
-    if (ret == 0) {
+    if (ret == 0 && !pending) {
         return;
     }
     if (ret < 0) {
@@ -133,6 +179,10 @@ static void worker_loop(ews_worker_t *worker)
         worker->shutdown = true;
     }
 
+    if (FD_ISSET(ews_wake_fd(&worker->wake), &rfds)) {
+        ews_wake_clear(&worker->wake);
+    }
+
 #if CONFIG_EWS_HTTP_CLIENTS > 0
     post_select(&ews->http_listener.sock, now, &rfds, &wfds);
     for (int i = 0; i < countof(ews->http_client); i++) {
@@ -153,20 +203,15 @@ static void worker_loop(ews_worker_t *worker)
 static void worker_task(void *arg)
 {
     ews_worker_t *worker = arg;
+#if CONFIG_EWS_HTTPS_CLIENTS > 0
+    ews_t *ews = container_of(worker, ews_t, worker);
 
-    while (!worker->shutdown) {
-        worker_loop(worker);
+    if (ews->config.https_crt) {
+        ews_tls_drbg_bind(&ews->tls.worker_drbg);
     }
+#endif
 
-    ews_timer_stop(&worker->timer);
-    ews_timer_destroy(&worker->timer);
-    ews_thread_destroy(&worker->thread);
-}
-
-static void task_reaper(void *arg)
-{
-    ews_worker_t *worker = arg;
-
-    ews_thread_destroy(&worker->thread);
-    ews_timer_destroy(&worker->timer);
+    while (!__atomic_load_n(&worker->shutdown, __ATOMIC_ACQUIRE)) {
+        worker_loop(worker);
+    }
 }
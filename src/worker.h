@@ -8,9 +8,10 @@ typedef struct ews_worker ews_worker_t;
 
 struct ews_worker {
     ews_thread_t thread;
-    ews_timer_t timer;
+    ews_wake_t wake;
     bool shutdown;
 };
 
 bool ews_worker_init(ews_worker_t *worker);
 void ews_worker_destroy(ews_worker_t *worker);
+void ews_worker_wake(ews_worker_t *worker);
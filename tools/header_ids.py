@@ -0,0 +1,234 @@
+#!/usr/bin/env python
+# SPDX-License-Identifier: MIT
+# generates the well-known header id enum and its perfect hash lookup
+from argparse import ArgumentParser
+import os
+import re
+
+
+HEADERS = [
+    'Accept',
+    'Accept-Charset',
+    'Accept-Encoding',
+    'Accept-Language',
+    'Access-Control-Request-Headers',
+    'Access-Control-Request-Method',
+    'Authorization',
+    'Cache-Control',
+    'Connection',
+    'Content-Disposition',
+    'Content-Encoding',
+    'Content-Length',
+    'Content-Type',
+    'Cookie',
+    'DNT',
+    'Date',
+    'Expect',
+    'Forwarded',
+    'Host',
+    'If-Match',
+    'If-Modified-Since',
+    'If-None-Match',
+    'If-Range',
+    'If-Unmodified-Since',
+    'Keep-Alive',
+    'Origin',
+    'Pragma',
+    'Priority',
+    'Range',
+    'Referer',
+    'Sec-Fetch-Dest',
+    'Sec-Fetch-Mode',
+    'Sec-Fetch-Site',
+    'Sec-Fetch-User',
+    'Sec-WebSocket-Extensions',
+    'Sec-WebSocket-Key',
+    'Sec-WebSocket-Protocol',
+    'Sec-WebSocket-Version',
+    'TE',
+    'Trailer',
+    'Transfer-Encoding',
+    'Upgrade',
+    'Upgrade-Insecure-Requests',
+    'User-Agent',
+    'Via',
+    'X-Forwarded-For',
+    'X-Forwarded-Host',
+    'X-Forwarded-Proto',
+    'X-Requested-With',
+]
+
+MASK = (1 << 64) - 1
+# odd 64-bit constant mixing each folded word into the hash
+MIX = 0x9E3779B97F4A7C15
+
+
+def fold_words(name):
+    """little endian 8-byte words with 0x20 or'ed into every byte"""
+    data = name.encode('ascii')
+    words = []
+    for i in range(0, len(data), 8):
+        chunk = data[i:i + 8]
+        word = int.from_bytes(chunk, 'little')
+        word |= int.from_bytes(b'\x20' * len(chunk), 'little')
+        words.append(word)
+    return words
+
+
+def hash_name(name, seed, bits):
+    h = len(name)
+    for word in fold_words(name):
+        h = ((h ^ word) * MIX) & MASK
+    return ((h * seed) & MASK) >> (64 - bits)
+
+
+def find_seed(names, bits):
+    seed = 1
+    for _ in range(1000000):
+        seed = (seed * 6364136223846793005 + 1442695040888963407) & MASK
+        seed |= 1
+        slots = set()
+        for name in names:
+            slot = hash_name(name, seed, bits)
+            if slot in slots:
+                break
+            slots.add(slot)
+        else:
+            return seed
+    return None
+
+
+def enum_name(name):
+    return 'EWS_HEADER_' + re.sub('[^A-Z0-9]', '_', name.upper())
+
+
+def save_header(path, names):
+    with open(path, 'w') as f:
+        f.write('// SPDX-License-Identifier: MIT\n')
+        f.write(f'// generated by tools/{os.path.basename(__file__)}, '
+                'do not edit\n')
+        f.write('#pragma once\n')
+        f.write('\n')
+        f.write('\n')
+        f.write('/// well-known header id type\n')
+        f.write('typedef enum ews_header_id ews_header_id_t;\n')
+        f.write('\n')
+        f.write('/// well-known header id enum\n')
+        f.write('enum ews_header_id {\n')
+        f.write('    EWS_HEADER_UNKNOWN,\n')
+        for name in names:
+            f.write(f'    {enum_name(name)},\n')
+        f.write('    EWS_HEADER_COUNT,\n')
+        f.write('};\n')
+
+
+def save_source(path, names, seed, bits):
+    slots = [0] * (1 << bits)
+    for i, name in enumerate(names):
+        slots[hash_name(name, seed, bits)] = i + 1
+
+    with open(path, 'w') as f:
+        f.write('// SPDX-License-Identifier: MIT\n')
+        f.write(f'// generated by tools/{os.path.basename(__file__)}, '
+                'do not edit\n')
+        f.write('#include <stddef.h>\n')
+        f.write('#include <stdint.h>\n')
+        f.write('#include <string.h>\n')
+        f.write('\n')
+        f.write('#include "ews.h"\n')
+        f.write('\n')
+        f.write('\n')
+        f.write(f'#define HEADER_BITS {bits}\n')
+        f.write(f'#define HEADER_SEED 0x{seed:016X}ull\n')
+        f.write(f'#define HEADER_MIX 0x{MIX:016X}ull\n')
+        f.write('\n')
+        f.write('static const char *const header_names[EWS_HEADER_COUNT] '
+                '= {\n')
+        f.write('    [EWS_HEADER_UNKNOWN] = NULL,\n')
+        for name in names:
+            f.write(f'    [{enum_name(name)}] = "{name}",\n')
+        f.write('};\n')
+        f.write('\n')
+        f.write('static const uint8_t header_lengths[EWS_HEADER_COUNT] '
+                '= {\n')
+        for name in names:
+            f.write(f'    [{enum_name(name)}] = {len(name)},\n')
+        f.write('};\n')
+        f.write('\n')
+        f.write('static const uint8_t header_slots[1 << HEADER_BITS] = {\n')
+        for i in range(0, len(slots), 8):
+            row = ', '.join(f'{slot:2d}' for slot in slots[i:i + 8])
+            f.write(f'    {row},\n')
+        f.write('};\n')
+        f.write('\n')
+        f.write(HEADER_LOOKUP_C)
+
+
+HEADER_LOOKUP_C = '''\
+/// up to eight bytes as a little endian word with 0x20 or'ed into every
+/// byte; that lowercases letters, and the only token characters it changes
+/// otherwise, '^' and '_', appear in no well-known name
+static inline uint64_t header_fold(const char *p, size_t len)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, p, len);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word | (0x2020202020202020ull >> (64 - 8 * len));
+}
+
+ews_header_id_t ews_header_lookup(const char *name, size_t len)
+{
+    uint64_t h = len;
+    const char *known;
+    uint8_t id;
+
+    if (len == 0 || len > UINT8_MAX) {
+        return EWS_HEADER_UNKNOWN;
+    }
+
+    for (size_t i = 0; i < len; i += 8) {
+        size_t n = len - i < 8 ? len - i : 8;
+        h = (h ^ header_fold(&name[i], n)) * HEADER_MIX;
+    }
+
+    id = header_slots[(h * HEADER_SEED) >> (64 - HEADER_BITS)];
+    if (id == EWS_HEADER_UNKNOWN || header_lengths[id] != len) {
+        return EWS_HEADER_UNKNOWN;
+    }
+
+    /// folding both sides is exact for tokens against the known names
+    known = header_names[id];
+    for (size_t i = 0; i < len; i += 8) {
+        size_t n = len - i < 8 ? len - i : 8;
+        if (header_fold(&name[i], n) != header_fold(&known[i], n)) {
+            return EWS_HEADER_UNKNOWN;
+        }
+    }
+    return id;
+}
+
+const char *ews_header_name(ews_header_id_t id)
+{
+    if (id >= EWS_HEADER_COUNT) {
+        return NULL;
+    }
+    return header_names[id];
+}
+'''
+
+if __name__ == '__main__':
+    parser = ArgumentParser()
+    parser.add_argument('--bits', type=int, default=7,
+            help='log2 of the hash table size')
+    parser.add_argument('header', metavar='HEADER', help='destination C header')
+    parser.add_argument('source', metavar='SOURCE', help='destination C source')
+    args = parser.parse_args()
+
+    seed = find_seed(HEADERS, args.bits)
+    if seed is None:
+        raise SystemExit(f'no perfect hash with {args.bits} bits, raise --bits')
+    save_header(args.header, HEADERS)
+    save_source(args.source, HEADERS, seed, args.bits)